@@ -1,5 +1,7 @@
 #include <acpi/acpi.h>
 #include <acpi/madt.h>
+#include <acpi/srat.h>
+#include <acpi/slit.h>
 #include <mm/mem.h>
 #include <boot/stivale2.h>
 #include <mem/mem.h>
@@ -111,11 +113,12 @@ sdt_header_t* acpi_find_table(char* table) {
 }
 
 /*
- * acpi_init
- * finds ACPI tables and parses MADT
+ * acpi_early_init
+ * finds RSDT/XSDT and parses the NUMA tables (SRAT, SLIT)
+ * NOTE: runs before pmm_init, must not use the kernel heap
  * @param handover : bootloader handover struct
  */
-void acpi_init(struct stivale2_struct* handover) {
+void acpi_early_init(struct stivale2_struct* handover) {
     struct stivale2_struct_tag_rsdp* rsdp_tag = (struct stivale2_struct_tag_rsdp*) stivale2_get_tag(handover, STIVALE2_STRUCT_TAG_RSDP_ID);
     if (rsdp_tag == NULL)
         panic("RSDP tag not found");
@@ -124,7 +127,7 @@ void acpi_init(struct stivale2_struct* handover) {
     if (!verify_rsdp_checksum(rsdp)) 
         panic("RSDP checksum could not be verified");
 
-    info("[acpi_init] rsdp revision: %u\n", rsdp->revision);
+    info("[acpi_early_init] rsdp revision: %u\n", rsdp->revision);
 
     rsdt.sdt_hdr = (sdt_header_t*) P2V(rsdp->rsdt_address);
     rsdt.acpi_version = rsdp->revision;
@@ -133,6 +136,25 @@ void acpi_init(struct stivale2_struct* handover) {
     if (!verify_sdt_checksum(rsdt.sdt_hdr))
         panic("RSDT/XSDT checksum could not be verified");
 
+    // find srat and slit, both are optional
+    sdt_header_t* srat_hdr = acpi_find_table("SRAT");
+    if (srat_hdr != NULL) 
+        parse_srat((sdt_header_t*) P2V((paddr_t) srat_hdr));
+
+    sdt_header_t* slit_hdr = acpi_find_table("SLIT");
+    if (slit_hdr != NULL) 
+        parse_slit((sdt_header_t*) P2V((paddr_t) slit_hdr));
+}
+
+/*
+ * acpi_init
+ * parses MADT
+ * NOTE: acpi_early_init must have found RSDT/XSDT
+ * @param handover : bootloader handover struct
+ */
+void acpi_init(struct stivale2_struct* handover) {
+    (void) handover;
+
     // find madt
     sdt_header_t* madt_hdr = acpi_find_table("APIC");
     if (madt_hdr == NULL) 
@@ -1,10 +1,14 @@
 #include <acpi/madt.h>
-#include <mm/kheap.h>
+#include <mem/arena.h>
 #include <intr/ioapic.h>
 #include <intr/lapic.h>
 #include <log.h>
 
 #define MAX_ENTRY_TYPE  10
+#define MADT_ARENA_CHUNK    512     // bytes of entry pointer arrays per arena chunk
+
+/* entry pointer arrays of madt_info */
+static arena_t madt_arena = ARENA_INIT(MADT_ARENA_CHUNK);
 
 /* coalesced info from MADT */
 madt_info_t madt_info = {
@@ -30,18 +34,7 @@ madt_info_t madt_info = {
  */
 static void reset_madt_info(void) {
     // free old lists
-    if (madt_info.lapics)
-        kfree(madt_info.lapics);
-    if (madt_info.io_apics)
-        kfree(madt_info.io_apics);
-    if (madt_info.intr_src_overrides)
-        kfree(madt_info.intr_src_overrides);
-    if (madt_info.nmi_srcs)
-        kfree(madt_info.nmi_srcs);
-    if (madt_info.lapic_nmis)
-        kfree(madt_info.lapic_nmis);
-    if (madt_info.lx2apics)
-        kfree(madt_info.lx2apics);
+    arena_release(&madt_arena);
 
     // reset counts and pointers
     madt_info.num_lapic                  = 0;
@@ -140,17 +133,17 @@ void parse_madt(sdt_header_t* madt_hdr) {
 
     // build madt_info struct
     if (madt_info.num_lapic)
-        madt_info.lapics = (madt_lapic_t**) kmalloc(madt_info.num_lapic * sizeof(madt_lapic_t*));
+        madt_info.lapics = (madt_lapic_t**) arena_alloc(&madt_arena, madt_info.num_lapic * sizeof(madt_lapic_t*), 0);
     if (madt_info.num_io_apic)
-        madt_info.io_apics = (madt_ioapic_t**) kmalloc(madt_info.num_io_apic * sizeof(madt_ioapic_t*));
+        madt_info.io_apics = (madt_ioapic_t**) arena_alloc(&madt_arena, madt_info.num_io_apic * sizeof(madt_ioapic_t*), 0);
     if (madt_info.num_intr_src_override)
-        madt_info.intr_src_overrides = (madt_intr_src_override_t**) kmalloc(madt_info.num_intr_src_override * sizeof(madt_intr_src_override_t*));
+        madt_info.intr_src_overrides = (madt_intr_src_override_t**) arena_alloc(&madt_arena, madt_info.num_intr_src_override * sizeof(madt_intr_src_override_t*), 0);
     if (madt_info.num_apic_nmi_src)
-        madt_info.nmi_srcs = (madt_apic_nmi_src_t**) kmalloc(madt_info.num_apic_nmi_src * sizeof(madt_apic_nmi_src_t*));
+        madt_info.nmi_srcs = (madt_apic_nmi_src_t**) arena_alloc(&madt_arena, madt_info.num_apic_nmi_src * sizeof(madt_apic_nmi_src_t*), 0);
     if (madt_info.num_lapic_nmi)
-        madt_info.lapic_nmis = (madt_lapic_nmi_t**) kmalloc(madt_info.num_lapic_nmi * sizeof(madt_lapic_nmi_t*));
+        madt_info.lapic_nmis = (madt_lapic_nmi_t**) arena_alloc(&madt_arena, madt_info.num_lapic_nmi * sizeof(madt_lapic_nmi_t*), 0);
     if (madt_info.num_lx2apic)
-        madt_info.lx2apics = (madt_lx2apic_t**) kmalloc(madt_info.num_lx2apic * sizeof(madt_lx2apic_t*));
+        madt_info.lx2apics = (madt_lx2apic_t**) arena_alloc(&madt_arena, madt_info.num_lx2apic * sizeof(madt_lx2apic_t*), 0);
 
     i = 0; 
     uint64_t entry_counters[MAX_ENTRY_TYPE] = {0};
@@ -0,0 +1,41 @@
+#include <acpi/slit.h>
+#include <acpi/srat.h>
+#include <log.h>
+
+/* SLIT, NULL if firmware does not provide one */
+static slit_t* slit = NULL;
+
+/*
+ * slit_distance
+ * @param from_node : node memory is accessed from
+ * @param to_node : node memory is located in
+ * @returns relative distance between the nodes, SLIT_LOCAL_DISTANCE if they are the same
+ */
+uint8_t slit_distance(uint32_t from_node, uint32_t to_node) {
+    srat_info_t* srat_info = get_srat_info();
+    uint64_t from_pxm = srat_info->node_pxm[from_node];
+    uint64_t to_pxm = srat_info->node_pxm[to_node];
+
+    if (slit == NULL || from_pxm >= slit->num_localities || to_pxm >= slit->num_localities)
+        return (from_node == to_node) ? SLIT_LOCAL_DISTANCE : SLIT_REMOTE_DISTANCE;
+
+    return slit->entries[from_pxm * slit->num_localities + to_pxm];
+}
+
+/*
+ * parse_slit
+ * stores SLIT for slit_distance lookups
+ * @param slit_hdr : pointer to header of SLIT
+ */
+void parse_slit(sdt_header_t* slit_hdr) {
+    slit = (slit_t*) slit_hdr;
+    info("[parse_slit] SLIT information:\n");
+    log("---------------------------\n");
+    log("[parse_slit] localities: %lu\n", slit->num_localities);
+
+    // verify the distance matrix fits in the table
+    if (sizeof(slit_t) + slit->num_localities * slit->num_localities > slit->sdt_hdr.length) {
+        warning("[parse_slit] distance matrix exceeds table length, ignoring SLIT\n");
+        slit = NULL;
+    }
+}
@@ -0,0 +1,123 @@
+#include <acpi/srat.h>
+#include <log.h>
+
+/* coalesced info from SRAT, a single node owns everything if there is no SRAT */
+static srat_info_t srat_info = {
+    .num_nodes                  = 1,
+    .node_pxm                   = {0},
+    .num_mem_ranges             = 0,
+    .lapic_node                 = {0}
+};
+
+/* 
+ * get_srat_info
+ * @returns pointer to srat_info struct
+ */
+srat_info_t* get_srat_info(void) {
+    return &srat_info;
+}
+
+/*
+ * srat_node_of_lapic
+ * @param lapic_id : lapic id of processor
+ * @returns node of processor with @param lapic_id, 0 if it is unknown
+ */
+uint32_t srat_node_of_lapic(uint32_t lapic_id) {
+    if (lapic_id >= SRAT_MAX_LAPICS)
+        return 0;
+
+    return srat_info.lapic_node[lapic_id];
+}
+
+/*
+ * srat_node_of_pxm
+ * finds the node of proximity domain @param pxm, adding a new node if it was not seen yet
+ * @returns node of @param pxm
+ */
+static uint32_t srat_node_of_pxm(uint32_t pxm) {
+    for (uint32_t node = 0; node < srat_info.num_nodes; node++) {
+        if (srat_info.node_pxm[node] == pxm)
+            return node;
+    }
+
+    if (srat_info.num_nodes == SRAT_MAX_NODES) {
+        warning("[parse_srat] more than %u proximity domains, domain %u is merged into node 0\n", SRAT_MAX_NODES, pxm);
+        return 0;
+    }
+
+    srat_info.node_pxm[srat_info.num_nodes] = pxm;
+    return srat_info.num_nodes++;
+}
+
+/*
+ * parse_srat
+ * parses SRAT and fills in fields of srat_info struct
+ * NOTE: runs before the kernel heap is initialized, everything is stored in fixed size tables
+ * @param srat_hdr : pointer to header of SRAT
+ */
+void parse_srat(sdt_header_t* srat_hdr) {
+    srat_t* srat = (srat_t*) srat_hdr;
+    info("[parse_srat] SRAT information:\n");
+    log("---------------------------\n");
+    log("[parse_srat] srat length: %u\n", srat->sdt_hdr.length);
+
+    // nodes are only created for proximity domains found below
+    srat_info.num_nodes = 0;
+    srat_info.num_mem_ranges = 0;
+
+    // parse srat entries
+    log("---------------------------\n");
+    uint32_t i = 0;
+    while (i < srat->sdt_hdr.length - SRAT_OFFSET) {
+        srat_header_t* entry_hdr = (srat_header_t*) &srat->data[i];
+
+        switch (entry_hdr->entry_type) {
+            case SRAT_PROC_AFFINITY:
+                srat_proc_affinity_t* entry0 = (srat_proc_affinity_t*) entry_hdr;
+                if (!(entry0->flags & SRAT_ENABLED))
+                    break;
+
+                uint32_t pxm0 = entry0->pxm_low | (entry0->pxm_high[0] << 8) | (entry0->pxm_high[1] << 16) | (entry0->pxm_high[2] << 24);
+                log("[parse_srat] SRAT_PROC_AFFINITY:\napic_id: %u, pxm: %u\n", entry0->apic_id, pxm0);
+                srat_info.lapic_node[entry0->apic_id] = srat_node_of_pxm(pxm0);
+                break;
+            case SRAT_MEM_AFFINITY:
+                srat_mem_affinity_t* entry1 = (srat_mem_affinity_t*) entry_hdr;
+                if (!(entry1->flags & SRAT_ENABLED) || entry1->length == 0)
+                    break;
+
+                log("[parse_srat] SRAT_MEM_AFFINITY:\nbase: 0x%lx, length: 0x%lx, pxm: %u\n", entry1->base, entry1->length, entry1->pxm);
+                if (srat_info.num_mem_ranges == SRAT_MAX_MEM_RANGES) {
+                    warning("[parse_srat] more than %u memory ranges, ignoring range at 0x%lx\n", SRAT_MAX_MEM_RANGES, entry1->base);
+                    break;
+                }
+
+                srat_info.mem_ranges[srat_info.num_mem_ranges++] = (srat_mem_range_t) {
+                    .base = entry1->base,
+                    .length = entry1->length,
+                    .node = srat_node_of_pxm(entry1->pxm)
+                };
+                break;
+            case SRAT_X2APIC_AFFINITY:
+                srat_x2apic_affinity_t* entry2 = (srat_x2apic_affinity_t*) entry_hdr;
+                if (!(entry2->flags & SRAT_ENABLED))
+                    break;
+
+                log("[parse_srat] SRAT_X2APIC_AFFINITY:\nx2apic_id: %u, pxm: %u\n", entry2->x2apic_id, entry2->pxm);
+                if (entry2->x2apic_id < SRAT_MAX_LAPICS)
+                    srat_info.lapic_node[entry2->x2apic_id] = srat_node_of_pxm(entry2->pxm);
+                break;
+            default:
+                warning("[parse_srat] unknown entry type was detected: %u\n", entry_hdr->entry_type);
+        }
+        log("---------------------------\n");
+
+        i += entry_hdr->length;
+    }
+
+    // SRAT without usable entries, fall back to a single node
+    if (srat_info.num_nodes == 0) {
+        srat_info.num_nodes = 1;
+        srat_info.node_pxm[0] = 0;
+    }
+}
@@ -13,6 +13,7 @@
 #include <mm/pmm.h>
 #include <mm/paging.h>
 #include <mm/kheap.h>
+#include <mm/tlb.h>
 #include <cpu/smp.h>
 #include <acpi/acpi.h>
 #include <ds/map.h>
@@ -25,22 +26,29 @@ void _start(struct stivale2_struct* handover) {
     gdt_init();
     idt_init();
     pic_disable();
+    acpi_early_init(handover);
     pmm_init(handover);
     paging_init(handover);
 
-    // TODO: make kernel heap global pages
     kheap_init(handover, KHEAP_INIT_PAGES);
     // TODO: map (map singular page up until 16 MiB) kernel eternal heap?
     // kheap_eternal_init();
 
     acpi_init(handover);
     apic_init(handover);
+    tlb_init();
     smp_init(handover);
 
     /* devices */
     kbd_init();
 
+    // initialize deferred memory and refill the pre-zeroed frame pool while idle
     for (;;) {
+        // steps are short and keep interrupts enabled, take them until all memory is initialized
+        if (pmm_init_deferred(1))
+            continue;
+
+        pmm_zero_idle();
         hlt();
     }
 }
\ No newline at end of file
@@ -2,8 +2,16 @@
 #include <intr/lapic.h>
 #include <boot/stivale2.h>
 #include <mm/pmm.h>
+#include <acpi/srat.h>
 #include <log.h>
 
+/* logical processor ids (0 is the BSP), indexed by lapic id */
+static uint8_t cpu_ids[SMP_MAX_LAPICS] = {0};
+static bool cpu_ids_valid = false;
+
+/* numa node of each processor, indexed by logical id */
+static uint8_t cpu_nodes[SMP_MAX_CPUS] = {0};
+
 /* 
  * smp_init
  * initializes other processors 
@@ -14,16 +22,60 @@ void smp_init(struct stivale2_struct* handover) {
     if (smp_info == NULL)
         panic("[smp_init] smp struct from bootloader could not be found\n");
 
+    // assign logical ids before any AP is started
+    uint32_t num_cpus = 1;
+    cpu_ids[smp_info->bsp_lapic_id] = 0;
+    cpu_nodes[0] = srat_node_of_lapic(smp_info->bsp_lapic_id);
+    for (uint64_t i = 0; i < smp_info->cpu_count; i++) {
+        struct stivale2_smp_info* proc = &smp_info->smp_info[i];
+
+        if (proc->lapic_id != smp_info->bsp_lapic_id && num_cpus < SMP_MAX_CPUS && proc->lapic_id < SMP_MAX_LAPICS) {
+            cpu_nodes[num_cpus] = srat_node_of_lapic(proc->lapic_id);
+            cpu_ids[proc->lapic_id] = num_cpus++;
+        }
+    }
+    cpu_ids_valid = true;
+
     for (uint64_t i = 0; i < smp_info->cpu_count; i++) {
         struct stivale2_smp_info* proc = &smp_info->smp_info[i];
 
         if (proc->lapic_id != smp_info->bsp_lapic_id) {
+            // processors without a logical id are left parked
+            if (proc->lapic_id >= SMP_MAX_LAPICS || cpu_ids[proc->lapic_id] == 0) {
+                warning("[smp_init] more than %u processors, not starting processor with lapic id %u\n", SMP_MAX_CPUS, proc->lapic_id);
+                continue;
+            }
+
             proc->target_stack = (uint64_t) pmm_alloc(PMM_ZONE_NORMAL, 1);
             proc->goto_address = (uint64_t) &smp_ap_entry;
         }
     }
 }
 
+/*
+ * smp_cpu_id
+ * @returns logical id of the current processor in [0, SMP_MAX_CPUS), the BSP is always 0
+ */
+uint32_t smp_cpu_id(void) {
+    // only the BSP runs before smp_init
+    if (!cpu_ids_valid)
+        return 0;
+
+    return cpu_ids[lapic_id()];
+}
+
+/*
+ * smp_cpu_node
+ * @returns numa node of the current processor
+ */
+uint32_t smp_cpu_node(void) {
+    // lapic_id needs the MADT, ask cpuid for the initial apic id of the BSP instead
+    if (!cpu_ids_valid)
+        return srat_node_of_lapic(cpuid_apic_id());
+
+    return cpu_nodes[smp_cpu_id()];
+}
+
 /* 
  * smp_ap_entry
  * when processors boot up, they will enter smp_ap_entry
@@ -35,6 +87,7 @@ void smp_ap_entry(void) {
     // initialize idt (???)
     // map kheap
     // lapic_enable();
+    // tlb_cpu_online();
 
     log("[smp_ap_entry] welcome to the club, processor %u!\n", lapic_id());
 
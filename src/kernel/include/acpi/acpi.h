@@ -37,4 +37,5 @@ typedef struct {
 
 sdt_header_t* acpi_find_table(char* table);
 rsdt_t* get_rsdt(void);
+void acpi_early_init(struct stivale2_struct* handover);
 void acpi_init(struct stivale2_struct* handover);
\ No newline at end of file
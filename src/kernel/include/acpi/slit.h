@@ -0,0 +1,18 @@
+#pragma once
+
+#include <sys/sys.h>
+#include <acpi/sdt.h>
+
+/* distances used when firmware provides no SLIT */
+#define SLIT_LOCAL_DISTANCE     10
+#define SLIT_REMOTE_DISTANCE    20
+
+/* SLIT */
+typedef struct {
+    sdt_header_t sdt_hdr;
+    uint64_t num_localities;
+    uint8_t entries[];          // num_localities x num_localities distance matrix, indexed by proximity domain
+} __attribute__((packed)) slit_t;
+
+uint8_t slit_distance(uint32_t from_node, uint32_t to_node);
+void parse_slit(sdt_header_t* slit_hdr);
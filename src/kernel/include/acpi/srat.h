@@ -0,0 +1,90 @@
+#pragma once
+
+#include <sys/sys.h>
+#include <mm/mem.h>
+#include <acpi/sdt.h>
+
+#define SRAT_PROC_AFFINITY          ((uint8_t) 0)
+#define SRAT_MEM_AFFINITY           ((uint8_t) 1)
+#define SRAT_X2APIC_AFFINITY        ((uint8_t) 2)
+
+#define SRAT_OFFSET                 ((uint8_t) 0x30)
+
+/* entry flags */
+#define SRAT_ENABLED                (1 << 0)
+
+/* limits of the parsed information, SRAT is parsed before the kernel heap exists */
+#define SRAT_MAX_NODES              8
+#define SRAT_MAX_MEM_RANGES         32
+#define SRAT_MAX_LAPICS             256
+
+/* SRAT */
+typedef struct {
+    sdt_header_t sdt_hdr;
+    uint32_t reserved1;
+    uint64_t reserved2;
+    uint8_t data[];
+} __attribute__((packed)) srat_t;
+
+/* headers for entries in SRAT */
+typedef struct {
+    uint8_t entry_type;
+    uint8_t length;
+} __attribute__ ((packed)) srat_header_t;
+
+/* SRAT entry structs */
+typedef struct {
+    srat_header_t srat_hdr;
+    uint8_t pxm_low;
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t sapic_eid;
+    uint8_t pxm_high[3];
+    uint32_t clock_domain;
+} __attribute__ ((packed)) srat_proc_affinity_t;
+
+typedef struct {
+    srat_header_t srat_hdr;
+    uint32_t pxm;
+    uint16_t reserved1;
+    uint64_t base;
+    uint64_t length;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+} __attribute__ ((packed)) srat_mem_affinity_t;
+
+typedef struct {
+    srat_header_t srat_hdr;
+    uint16_t reserved1;
+    uint32_t pxm;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__ ((packed)) srat_x2apic_affinity_t;
+
+/* memory range of a node */
+typedef struct {
+    paddr_t base;
+    size_t length;
+    uint32_t node;
+} srat_mem_range_t;
+
+/* 
+ * SRAT info struct 
+ * NOTE: nodes are numbered [0, num_nodes) in the order their proximity domains appear in SRAT
+ */
+typedef struct {
+    uint32_t num_nodes;
+    uint32_t node_pxm[SRAT_MAX_NODES];
+
+    uint32_t num_mem_ranges;
+    srat_mem_range_t mem_ranges[SRAT_MAX_MEM_RANGES];
+
+    uint8_t lapic_node[SRAT_MAX_LAPICS];
+} srat_info_t;
+
+srat_info_t* get_srat_info(void);
+uint32_t srat_node_of_lapic(uint32_t lapic_id);
+void parse_srat(sdt_header_t* srat_hdr);
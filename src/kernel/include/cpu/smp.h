@@ -3,5 +3,13 @@
 #include <sys/sys.h>
 #include <stivale/stivale2.h>
 
+/* max number of processors brought up by smp_init */
+#define SMP_MAX_CPUS    64
+
+/* xAPIC ids are 8 bits wide */
+#define SMP_MAX_LAPICS  256
+
 void smp_init(struct stivale2_struct* handover);
-void smp_ap_entry(void);
\ No newline at end of file
+void smp_ap_entry(void);
+uint32_t smp_cpu_id(void);
+uint32_t smp_cpu_node(void);
\ No newline at end of file
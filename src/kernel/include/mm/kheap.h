@@ -5,7 +5,26 @@
 #include <stivale/stivale2.h>
 
 #define KHEAP_INIT_PAGES    1
-#define KHEAP_MIN_FREE_SIZE 1
+#define KHEAP_MAP_BATCH     64      // page frames allocated at once when mapping heap pages
+
+/* large objects, requests of at least KHEAP_LARGE_MIN bytes are backed by their own pages */
+#define KHEAP_LARGE_MIN     (4 * PAGE_SIZE)                 // rounding to pages wastes less than a quarter
+#define KHEAP_LARGE_START   ((vaddr_t) 0xffffc00000000000)  // behind 64 TiB of HHDM
+#define KHEAP_LARGE_SLOT    (16 * MiB)                      // objects grow in place within their slots
+#define KHEAP_LARGE_SLOTS   (256 * KiB)                     // 4 TiB of large objects
+#define KHEAP_LARGE_END     (KHEAP_LARGE_START + (vaddr_t) KHEAP_LARGE_SLOTS * KHEAP_LARGE_SLOT)
+
+/* trimming, free memory is given back to the pmm on kfree */
+#define KHEAP_TRIM_KEEP         (64 * KiB)      // free bytes kept mapped at kheap_top
+#define KHEAP_TRIM_THRESHOLD    (256 * KiB)     // free blocks of at least this size release their inner pages
+
+/* segregated free lists, each first level list covers a power of 2 of block sizes */
+#define KHEAP_ALIGN         8                               // block sizes and payloads are multiples of this
+#define KHEAP_SL_LOG2       4
+#define KHEAP_SL_COUNT      (1 << KHEAP_SL_LOG2)            // second level lists per first level list
+#define KHEAP_FL_SHIFT      (KHEAP_SL_LOG2 + 3)
+#define KHEAP_SMALL_BLOCK   (1 << KHEAP_FL_SHIFT)           // blocks below this size share first level list 0
+#define KHEAP_FL_COUNT      (47 - KHEAP_FL_SHIFT + 1)       // blocks are smaller than the 2^47 bytes of the higher half
 
 /* kernel heap api */
 void* kmalloc(size_t size);
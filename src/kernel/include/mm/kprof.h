@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sys/sys.h>
+#include <mm/mem.h>
+
+/* heap profiler, records per call site statistics of kmalloc, kfree and krealloc */
+#define KPROF_ENABLED       0
+#define KPROF_NUM_SITES     256     // call sites tracked, requests of further sites are only counted as dropped
+#define KPROF_NUM_LIVE      4096    // live allocations tracked for lifetimes, power of 2
+#define KPROF_NUM_BUCKETS   24      // size histogram, bucket i counts requests of [2^i, 2^(i+1)) bytes, the last one all larger
+
+/*
+ * statistics of a single call site
+ * NOTE: frees and lifetimes are accounted to the site that allocated the object
+ */
+typedef struct {
+    vaddr_t site;               // return address of kmalloc or krealloc, 0 if unused
+    size_t num_allocs;
+    size_t num_reallocs;
+    size_t num_frees;
+    size_t bytes;               // bytes requested by allocations and reallocations
+    size_t live_bytes;          // bytes of tracked objects that are not freed yet
+    uint64_t lifetime;          // cycles freed tracked objects lived in total
+    uint64_t max_lifetime;
+    size_t hist[KPROF_NUM_BUCKETS];
+} kprof_site_t;
+
+/* live object, kept in an open addressing table by address */
+typedef struct {
+    void* ptr;                  // NULL if unused
+    size_t size;
+    uint64_t tsc;               // time stamp of the allocation
+    kprof_site_t* site;
+} kprof_live_t;
+
+#if KPROF_ENABLED
+void kprof_alloc(void* site, void* ptr, size_t size);
+void kprof_realloc(void* site, void* old_ptr, void* new_ptr, size_t size);
+void kprof_free(void* ptr);
+#else
+static inline void kprof_alloc(void* site, void* ptr, size_t size) { (void) site; (void) ptr; (void) size; }
+static inline void kprof_realloc(void* site, void* old_ptr, void* new_ptr, size_t size) { (void) site; (void) old_ptr; (void) new_ptr; (void) size; }
+static inline void kprof_free(void* ptr) { (void) ptr; }
+#endif
+
+/* debugging */
+void parse_profile(void);
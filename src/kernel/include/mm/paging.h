@@ -18,6 +18,7 @@
 #define PAGE_OFFSET_SIZE    12
 #define PAGE_IDX_SIZE       9
 #define PAGE_IDX_MASK       ((uint64_t) 0x1ff)
+#define PAGE_TABLE_ENTRIES  512
 
 /* 
  * 4-level paging
@@ -32,7 +33,8 @@ typedef enum {
     PAGE_WRITE_THROUGH =    0x0000000000000008, 
     PAGE_CACHE_DISABLE =    0x0000000000000010, 
     PAGE_ACCESSED =         0x0000000000000020,
-    PAGE_PSIZE =            0x0000000000000080, // not applicable to pml4 table
+    PAGE_PSIZE =            0x0000000000000080, // 2 MiB page in pml2, 1 GiB page in pml3, not applicable to pml4 table
+    PAGE_GLOBAL =           0x0000000000000100, // kept in the tlb across cr3 loads, only for mappings shared by all address spaces
     PAGE_ADDR =             0x000ffffffffff000,
     PAGE_EXECUTE_DISABLE =  0x8000000000000000
 } pmask_e;
@@ -48,9 +50,37 @@ typedef uint64_t pml_entry_t;
 
 /* tables */
 typedef struct {
-    pml_entry_t entries[512];
+    pml_entry_t entries[PAGE_TABLE_ENTRIES];
 } pml_table_t;
 
+/* cr4 bits, refer to section 2.5 of Intel manual */
+#define CR4_PGE             (1 << 7)
+#define CR4_PCIDE           (1 << 17)
+
+/* 
+ * process context identifiers, refer to section 4.10.1 of Intel manual
+ * with CR4.PCIDE set, the low 12 bits of cr3 tag tlb entries and loading cr3 with bit 63 set
+ * keeps the entries already tagged with the loaded pcid
+ */
+#define CR3_PCID_MASK       ((uint64_t) 0xfff)
+#define CR3_NOFLUSH         ((uint64_t) 1 << 63)
+#define PAGING_NUM_PCIDS    4096
+#define PAGING_KERNEL_PCID  0       // kernel_space and address spaces that did not get a pcid, flushed on every switch
+
+/* address spaces */
+typedef struct {
+    pml_table_t* pml4_table;        // physical address of pml4 table
+    uint16_t pcid;
+    volatile uint64_t tlb_cpus;     // processors whose tlb may hold entries tagged with pcid, one bit per logical id
+    volatile uint64_t active_cpus;  // processors with the address space loaded
+} addrspace_t;
+
+extern addrspace_t kernel_space;
+
+/* invalidations collected by the unmap functions, see mm/tlb.h */
+typedef struct __tlb_batch_t tlb_batch_t;
+extern bool paging_ready;
+
 void paging_init(struct stivale2_struct* handover);
 
 /* page fault handler */
@@ -63,13 +93,25 @@ void paging_destroy(pml_table_t* ptable);
 
 void __paging_map(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_t flags);
 void __paging_maps(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags);
-void __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr);
+void __paging_map_frames(pml_table_t* pml4_table, vaddr_t vaddr, const paddr_t* frames, uint64_t num, uint64_t flags);
+void __paging_maps_large(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags);
+bool __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr);
 void __paging_unmaps(pml_table_t* pml4_table, vaddr_t vaddr, uint64_t num);
+uint64_t __paging_unmap_frames(pml_table_t* pml4_table, vaddr_t vaddr, uint64_t num, paddr_t* frames);
+paddr_t __paging_translate(pml_table_t* pml4_table, vaddr_t vaddr);
 
 void paging_map(vaddr_t vaddr, paddr_t paddr, uint64_t flags);
 void paging_maps(vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags);
-void paging_unmap(vaddr_t vaddr);
-void paging_unmaps(vaddr_t vaddr, uint64_t num);
+void paging_map_frames(vaddr_t vaddr, const paddr_t* frames, uint64_t num, uint64_t flags);
+void paging_unmap(vaddr_t vaddr, tlb_batch_t* batch);
+void paging_unmaps(vaddr_t vaddr, uint64_t num, tlb_batch_t* batch);
+uint64_t paging_unmap_frames(vaddr_t vaddr, uint64_t num, paddr_t* frames, tlb_batch_t* batch);
+paddr_t paging_translate(vaddr_t vaddr);
+
+void paging_space_create(addrspace_t* space);
+void paging_space_destroy(addrspace_t* space);
+void paging_switch(addrspace_t* space);
+addrspace_t* paging_current_space(void);
 
 void paging_set_flags(pml_entry_t* pentry, uint64_t flags);
 void paging_clear_flags(pml_entry_t* pentry, uint64_t flags);
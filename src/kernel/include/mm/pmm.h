@@ -8,23 +8,122 @@
 #define PMM_USED    1
 #define PMM_FREE    0
 
+/* largest buddy block is 2^PMM_MAX_ORDER pages (1 GiB) */
+#define PMM_MAX_ORDER   18
+
+/* alignments (in pages) for pmm_alloc_aligned */
+#define PMM_ALIGN_2M    ((2 * MiB) / PAGE_SIZE)
+#define PMM_ALIGN_1G    (GiB / PAGE_SIZE)
+
+/* per-cpu page frame caches */
+#define PMM_PCP_SIZE    64      // max frames cached per cpu and zone
+#define PMM_PCP_BATCH   16      // frames moved between a cache and its zone at once
+
+/* page colouring, single frame allocations are spread across the colours of the L2 cache */
+#define PMM_COLOURING       1
+#define PMM_CACHE_LEVEL     2
+#define PMM_MAX_COLOURS     PMM_PCP_SIZE    // colours are picked from the frames of a per-cpu cache
+
+/* deferred initialization, memory above PMM_DEFER_START is initialized in steps after boot */
+#define PMM_DEFER_START     ((paddr_t) 4 * GiB)     // bootloader HHDM ends here
+#define PMM_DEFER_CHUNK     ((paddr_t) GiB)         // descriptors are initialized a chunk ahead, one PMM_MAX_ORDER block
+#define PMM_DEFER_STEP      ((paddr_t) 2 * MiB)     // bytes of descriptors or memory initialized per step
+
+/* pre-zeroed page frame pools */
+#define PMM_ZERO_POOL_SIZE  256     // max zeroed frames kept per node
+#define PMM_ZERO_BATCH      8       // frames zeroed per call of pmm_zero_idle
+
 typedef enum {
     PMM_ZONE_DMA,
     PMM_ZONE_NORMAL,
     PMM_NUM_ZONES
 } zone_e;
 
+/*
+ * free buddy block header
+ * NOTE: lives in the first bytes of every free block and is accessed through the HHDM
+ */
+typedef struct __pmm_block_t {
+    struct __pmm_block_t* next;
+    struct __pmm_block_t* prev;
+} pmm_block_t;
+
+/* free blocks of a single order */
 typedef struct {
+    pmm_block_t* head;          // circular doubly linked list of free blocks
+    size_t num_free;            // number of free blocks in list
+} free_area_t;
+
+/* page frame flags */
+#define PG_RESERVED     (1 << 0)    // frame is not usable memory or holds the page frame array
+#define PG_BUDDY        (1 << 1)    // frame is the first page of a free buddy block of page->order
+
+/*
+ * page frame descriptor, one for every page frame of physical memory indexed by page frame number
+ * NOTE: 32 bytes, two descriptors share a cache line and none straddles one
+ */
+typedef struct {
+    uint16_t flags;
+    uint8_t order;              // order of the free block starting at this frame (PG_BUDDY)
+    uint8_t zone_idx;           // owning zone, node * PMM_NUM_ZONES + zone
+    uint32_t refcount;          // references on the frame, 1 after pmm_alloc and 0 while free
+    uint32_t map_count;         // number of page table entries mapping the frame
+    uint32_t reserved;
+    void* owner;                // object the frame belongs to (i.e. an address space), NULL if none
+    uint64_t private;           // owner specific data
+} page_t;
+
+/*
+ * per-cpu cache of single free page frames
+ * NOTE: frames[count - 1] is the most recently freed (cache hot) frame, frames[0] the coldest
+ */
+typedef struct {
+    size_t count;
+    size_t next_colour;         // cache colour of the next frame handed out
+    paddr_t frames[PMM_PCP_SIZE];
+} pcp_t;
+
+/* 
+ * pool of zeroed single frames from the NORMAL zone of a node 
+ * NOTE: pooled frames are accounted as used by their zone
+ */
+typedef struct {
+    spinlock_t lock;
+    size_t count;
+    paddr_t frames[PMM_ZERO_POOL_SIZE];
+} zero_pool_t;
+
+typedef struct {
+    spinlock_t lock;
     size_t mem_total;
     size_t mem_free;
     size_t mem_used;
     paddr_t offset;
     bitmap_t bitmap;
+    bitmap_summary_t summary;   // summary levels of bitmap for fast free run lookups
     size_t first_free_idx;
     zone_e zone;
+    uint32_t node;              // numa node the zone belongs to
+    free_area_t free_area[PMM_MAX_ORDER + 1];
 } zone_t;
 
+/* page frame descriptors */
+extern page_t* pmm_pages;
+#define pfn_to_page(pfn)    (&pmm_pages[(pfn)])
+#define page_to_pfn(page)   ((size_t) ((page) - pmm_pages))
+#define addr_to_page(addr)  pfn_to_page((addr) / PAGE_SIZE)
+#define page_to_addr(page)  ((paddr_t) page_to_pfn(page) * PAGE_SIZE)
+
 /* pmm api */
 paddr_t pmm_alloc(zone_e zone, size_t size);
+paddr_t pmm_alloc_node(uint32_t node, zone_e zone, size_t size);
+paddr_t pmm_alloc_aligned(zone_e zone, size_t size, size_t align);
+paddr_t pmm_alloc_zeroed(zone_e zone, size_t size);
+void pmm_zero_idle(void);
+bool pmm_init_deferred(size_t num);
 void pmm_free(paddr_t addr, size_t size);
+void pmm_alloc_bulk(zone_e zone, size_t num, paddr_t* frames);
+void pmm_free_bulk(paddr_t* frames, size_t num);
+void pmm_page_get(paddr_t addr);
+void pmm_page_put(paddr_t addr);
 void pmm_init(struct stivale2_struct* handover);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <sys/sys.h>
+#include <mm/mem.h>
+#include <cpu/smp.h>
+
+/* kmalloc size classes, powers of 2 from SLAB_MIN_SIZE to SLAB_MAX_SIZE */
+#define SLAB_MIN_SIZE       8
+#define SLAB_MAX_SIZE       2048
+#define SLAB_NUM_CLASSES    9
+
+#define SLAB_MAX_PAGES      8       // max page frames per slab
+#define SLAB_ALIGN          64      // kmalloc objects of at least this size start on a cache line
+#define SLAB_MIN_ALIGN      8       // default object alignment
+
+#define KMEM_MAG_SIZE       14      // objects per magazine, a magazine is 128 bytes
+#define KMEM_DEPOT_MAX      8       // full magazines kept in the depot of a cache
+
+/*
+ * slab header, lives in the first bytes of the slab's page frames and is accessed through the HHDM
+ * NOTE: every frame of a slab has its descriptor's owner pointing to the slab
+ */
+typedef struct __slab_t {
+    struct __slab_t* next;
+    struct __slab_t* prev;
+    struct __kmem_cache_t* cache;
+    void* free;                 // singly linked list of free objects, linked through the object's link word
+    size_t num_free;
+} slab_t;
+
+/* object constructor, run once per object when its slab is created */
+typedef void (*kmem_ctor_t)(void* obj);
+
+/*
+ * per-cache statistics of the slab layer
+ * NOTE: objects cached in magazines count as active
+ */
+typedef struct {
+    size_t num_allocs;          // objects taken from slabs since creation
+    size_t num_frees;           // objects returned to slabs since creation
+    size_t num_active;          // objects outside of slabs
+    size_t num_slabs;           // slabs currently owned by the cache
+} kmem_stats_t;
+
+/* stack of free objects, exchanged whole between processors and the depot of a cache */
+typedef struct __kmem_magazine_t {
+    struct __kmem_magazine_t* next;     // depot list
+    size_t rounds;                      // number of objects in magazine
+    void* objs[KMEM_MAG_SIZE];
+} kmem_magazine_t;
+
+/*
+ * per-cpu front end of a cache, only touched by its processor with interrupts disabled
+ * NOTE: prev is always either full or empty
+ */
+typedef struct {
+    kmem_magazine_t* loaded;    // magazine allocations and frees are served from
+    kmem_magazine_t* prev;      // previously loaded magazine
+    size_t num_allocs;          // kmem_cache_alloc calls on this processor
+    size_t num_frees;           // kmem_cache_free calls on this processor
+} kmem_cpu_cache_t;
+
+/*
+ * cache of equally sized objects
+ * NOTE: full slabs are on no list, they are found through the page frame descriptors on free
+ * NOTE: objects of caches with a constructor must be returned in their constructed state,
+ *       their free list link is kept behind the object so the constructed contents survive
+ * NOTE: most allocations and frees only touch the per-cpu magazines, full and empty magazines
+ *       are exchanged with the depot, only the depot and slab layers take a lock
+ */
+typedef struct __kmem_cache_t {
+    spinlock_t lock;            // slab layer lock
+    const char* name;
+    size_t size;                // requested object size
+    size_t align;               // object alignment
+    size_t stride;              // distance between objects
+    size_t link;                // offset of the free list link within an object
+    size_t offset;              // offset of the first object from the slab header
+    size_t num_pages;           // page frames per slab
+    size_t num_objs;            // objects per slab
+    kmem_ctor_t ctor;
+    slab_t* partial;            // slabs with free and used objects
+    slab_t* empty;              // a single completely free slab kept for reuse
+    kmem_stats_t stats;
+    bool magazines;             // whether the per-cpu magazines are used
+    kmem_cpu_cache_t cpu[SMP_MAX_CPUS];
+    spinlock_t depot_lock;
+    kmem_magazine_t* depot_full;    // full magazines not loaded by any processor
+    size_t depot_num_full;          // number of magazines in depot_full, at most KMEM_DEPOT_MAX
+    kmem_magazine_t* depot_empty;   // empty magazines not loaded by any processor
+    struct __kmem_cache_t* next;    // list of all caches
+} kmem_cache_t;
+
+/* object cache api */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor_t ctor);
+kmem_cache_t* kmem_cache_lazy(kmem_cache_t** cache, const char* name, size_t size, size_t align, kmem_ctor_t ctor);
+void kmem_cache_destroy(kmem_cache_t* cache);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* kmalloc backend */
+void* slab_alloc(size_t size);
+void slab_free(void* obj);
+size_t slab_size(void* obj);
+void slab_init(void);
+
+/* debugging */
+void parse_caches(void);
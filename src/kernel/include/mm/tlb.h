@@ -0,0 +1,55 @@
+#pragma once
+
+#include <sys/sys.h>
+#include <mm/paging.h>
+#include <cpu/smp.h>
+
+/*
+ * tlb shootdowns
+ * after page table entries are cleared, every processor that may cache them must invalidate them.
+ * invalidations are collected in a batch and sent to the processors running the address space with
+ * one IPI each, the initiator flushes its own tlb while they do the same
+ */
+
+#define TLB_INTR_VEC            0xFD
+#define TLB_BATCH_RANGES        8       // ranges a batch keeps before it flushes the whole tlb instead
+#define TLB_FLUSH_THRESHOLD     32      // pages above which the whole tlb is flushed instead of invlpg per page
+#define TLB_QUEUE_SIZE          (2 * SMP_MAX_CPUS)  // batches a processor can have pending, see tlb_batch_flush
+
+typedef struct {
+    vaddr_t start;
+    uint64_t num;
+} tlb_range_t;
+
+/*
+ * invalidations for one address space
+ * NOTE: remote processors read the batch until they acknowledged it, it must stay alive until tlb_batch_wait returns
+ */
+typedef struct __tlb_batch_t {
+    addrspace_t* space;
+    tlb_range_t ranges[TLB_BATCH_RANGES];
+    size_t num_ranges;
+    uint64_t num_pages;
+    bool full;                          // flush the whole tlb instead of the ranges
+    volatile uint32_t pending;          // processors that did not acknowledge the batch yet
+} tlb_batch_t;
+
+#define TLB_BATCH_INIT(s)   { .space = (s), .num_ranges = 0, .num_pages = 0, .full = false, .pending = 0 }
+
+/* batches sent to a processor */
+typedef struct {
+    spinlock_t lock;
+    tlb_batch_t* queue[TLB_QUEUE_SIZE];
+    size_t num;
+} tlb_mailbox_t;
+
+void tlb_init(void);
+void tlb_cpu_online(void);
+
+void tlb_batch_add(tlb_batch_t* batch, vaddr_t start, uint64_t num);
+void tlb_batch_flush(tlb_batch_t* batch);
+void tlb_batch_wait(tlb_batch_t* batch);
+void tlb_poll(void);
+
+void tlb_intr_handler(void);
+extern void wrapper_tlb_intr_handler(void);
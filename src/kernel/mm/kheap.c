@@ -1,145 +1,244 @@
 #include <mm/kheap.h>
 #include <mm/paging.h>
+#include <mm/tlb.h>
 #include <mm/pmm.h>
+#include <mm/slab.h>
+#include <mm/kprof.h>
+#include <ds/bitmap.h>
 
 /* 
  * lower addresses <-------------------------------> higher addresses
  * 
  *   kheap_top                                            VA_END
  * ----------------------------------------------------------
- *       |   |             |   |                            |
- *       |hdr|     free    |hdr|          used              |
- *       |   |             |   |                            |
+ *       |   |           |   |   |                  |   |
+ *       |hdr|    free   |ftr|hdr|       used       |hdr| (epilogue)
+ *       |   |           |   |   |                  |   |
  * ----------------------------------------------------------
  * 
  * General notes:
- * - a memblock_t header is free only if free_next and free_prev are NULL
+ * - the heap is a two-level segregated fit (TLSF) allocator, free blocks are kept in
+ *   free_lists[fl][sl] by size, fl_bitmap and sl_bitmap[fl] mark the non-empty lists
+ * - first level lists hold power of 2 size ranges, each split into KHEAP_SL_COUNT second level lists
+ * - allocation, free and merges are constant time, no free list is ever walked
+ * - blocks are physically contiguous and carry boundary tags: a used block only has its size word,
+ *   a free block also repeats its size in a footer (its last word). the next block is found through
+ *   the size and a free previous block through the footer in front of the header (KHEAP_BLOCK_PREV_FREE),
+ *   so neighbours are merged in place and headers never move
+ * - free_next and free_prev overlap the payload and are only valid while the block is free
  * - kheap_top MUST be PAGE_SIZE aligned
- * - block_head always points to memblock_t header closest to kheap_top (for kheap_expand)
- * - free_head can be any free block
- * - any block that is_free does not need to do NULL checks on free_next and free_prev
- * - freelist is a circular doubly linked list
- * - block (header) list is a normal doubly linked list
+ * - the block at kheap_top is the first block, its KHEAP_BLOCK_PREV_FREE is never set
+ * - the epilogue is a used block of size 0 at the end of the heap, every other block has a next block
+ * - free memory is given back to the pmm on kfree: the heap shrinks back to KHEAP_TRIM_KEEP free bytes at
+ *   kheap_top and free blocks of KHEAP_TRIM_THRESHOLD bytes or more lose the page frames of their inner pages
+ *   (KHEAP_BLOCK_TRIMMED). pages holding headers, free list links or footers are always backed
+ * - requests of at most SLAB_MAX_SIZE bytes are served by slab size classes in the HHDM,
+ *   so any pointer below kheap_top belongs to a slab (unless it is a large object)
+ * - requests of at least KHEAP_LARGE_MIN bytes are large objects, each gets its own pages in
+ *   KHEAP_LARGE_SLOT sized slots of the large object region. the first page frame of an object
+ *   records it (owner is the object, private its number of pages)
+ * - unmapped page frames are collected while a heap lock is held and their tlb batch is flushed before it is
+ *   dropped. the frames go back to the pmm only after the lock is dropped and every processor acknowledged,
+ *   a processor spinning on the lock with interrupts disabled could not acknowledge. heap_lock carries out the
+ *   batches queued for a processor right after it takes a lock, so no processor touches heap memory or maps
+ *   pages again through an entry its previous holders invalidated
 */
 
 /* header struct */
 struct __kheap_header_t {
-    struct __kheap_header_t* next;
-    struct __kheap_header_t* prev;
-    struct __kheap_header_t* free_next;
+    size_t size;                            // payload size in bytes, low bits hold KHEAP_BLOCK_* flags
+    struct __kheap_header_t* free_next;     // free list links, overlap the payload
     struct __kheap_header_t* free_prev;
-    size_t size;
 };
 typedef struct __kheap_header_t memblock_t;
 
+/* page frames unmapped from the heap that were not given back to the pmm yet */
+typedef struct {
+    tlb_batch_t batch;          // invalidations of the unmapped pages
+    paddr_t frames;             // list of page frames, each links the next one in its page->private
+    size_t num;
+} unmapped_t;
+
+#define UNMAPPED_INIT   { .batch = TLB_BATCH_INIT(&kernel_space), .frames = 0, .num = 0 }
+
+/* block flags */
+#define KHEAP_BLOCK_FREE        (1 << 0)
+#define KHEAP_BLOCK_PREV_FREE   (1 << 1)    // physically previous block is free, its footer is valid
+#define KHEAP_BLOCK_TRIMMED     (1 << 2)    // inner pages of the free block may not be backed by page frames
+#define KHEAP_BLOCK_FLAGS       (KHEAP_ALIGN - 1)
+
 /* utility macros */
-#define is_free(hdr)            (hdr->free_next != NULL && hdr->free_prev != NULL)
-#define block_start_addr(hdr)   (((vaddr_t) hdr) + sizeof(memblock_t))
-#define block_end_addr(hdr)     (((vaddr_t) hdr) + sizeof(memblock_t) - 1 + hdr->size)  // NOTE: -1 necessary for VA_END
+#define HDR_SIZE                sizeof(size_t)                                          // header bytes of a used block
+#define MIN_BLOCK_SIZE          (2 * sizeof(void*) + sizeof(size_t))                    // payload must fit the free list links and footer
+#define is_free(hdr)            ((hdr)->size & KHEAP_BLOCK_FREE)
+#define is_prev_free(hdr)       ((hdr)->size & KHEAP_BLOCK_PREV_FREE)
+#define block_size(hdr)         ((hdr)->size & ~((size_t) KHEAP_BLOCK_FLAGS))
+#define block_start_addr(hdr)   (((vaddr_t) (hdr)) + HDR_SIZE)
+#define block_next(hdr)         ((memblock_t*) (block_start_addr(hdr) + block_size(hdr)))
+#define block_footer(hdr)       (*(size_t*) (block_start_addr(hdr) + block_size(hdr) - sizeof(size_t)))
+#define block_prev(hdr)         ((memblock_t*) ((vaddr_t) (hdr) - *((size_t*) (hdr) - 1) - HDR_SIZE))   // NOTE: only if is_prev_free
+#define ptr_to_block(ptr)       ((memblock_t*) ((vaddr_t) (ptr) - HDR_SIZE))
+#define is_slab_obj(ptr)        (((vaddr_t) ptr) < kheap_top)
+#define is_large_obj(ptr)       (((vaddr_t) (ptr)) >= KHEAP_LARGE_START && ((vaddr_t) (ptr)) < KHEAP_LARGE_END)
 
 /* globals for managing heap */
 vaddr_t kheap_top = 0;                          /* VA for top of heap */
 vaddr_t kheap_max = 0;                          // TODO: set in paging_init
-static memblock_t* free_head = NULL;            /* head of freelist headers */
-static memblock_t* block_head = NULL;           /* list of ALL headers */
+static spinlock_t kheap_lock = SPINLOCK_INIT;   /* protects the heap, small objects never take it */
+
+/* slots of the large object region, a set bit is a reserved slot */
+#define LARGE_SUMMARY_WORDS     (2 * (KHEAP_LARGE_SLOTS / BITMAP_WORD_BITS / BITMAP_WORD_BITS) + 2)
+static uint64_t large_slots_data[KHEAP_LARGE_SLOTS / BITMAP_WORD_BITS];
+static uint64_t large_summary_data[LARGE_SUMMARY_WORDS];
+static bitmap_summary_t large_summary;
+static bitmap_t large_slots = { .size = KHEAP_LARGE_SLOTS, .data = large_slots_data };
+static spinlock_t large_lock = SPINLOCK_INIT;   /* protects the large object region */
+
+#define large_slot_addr(slot)       (KHEAP_LARGE_START + (vaddr_t) (slot) * KHEAP_LARGE_SLOT)
+#define large_addr_slot(addr)       (((vaddr_t) (addr) - KHEAP_LARGE_START) / KHEAP_LARGE_SLOT)
+#define large_num_slots(pages)      (ALIGN_UP((pages) * PAGE_SIZE, KHEAP_LARGE_SLOT) / KHEAP_LARGE_SLOT)
+#define large_num_pages(size)       MAX(ALIGN_UP(size, PAGE_SIZE) / PAGE_SIZE, 1)
+
+/* segregated free lists */
+static uint64_t fl_bitmap = 0;
+static uint32_t sl_bitmap[KHEAP_FL_COUNT];
+static memblock_t* free_lists[KHEAP_FL_COUNT][KHEAP_SL_COUNT];
 
-/* utility freelist functions */
-static inline void freelist_insert(memblock_t* hdr) {
-    // insert hdr into freelist
-    if (free_head == NULL) {
-        free_head = hdr;
-        hdr->free_next = hdr;
-        hdr->free_prev = hdr;
+/*
+ * heap_lock
+ * takes @param lock with interrupts disabled and carries out the tlb batches sent to the current processor,
+ * batches its previous holders flushed under the lock are queued by then
+ * @returns rflags to restore with spin_unlock_irqrestore
+ */
+static inline uint64_t heap_lock(spinlock_t* lock) {
+    uint64_t rflags = spin_lock_irqsave(lock);
+    tlb_poll();
+    return rflags;
+}
+
+/*
+ * mapping_insert
+ * finds the free list that blocks of @param size bytes belong to
+ * @param fl : filled with first level index
+ * @param sl : filled with second level index
+ */
+static inline void mapping_insert(size_t size, uint32_t* fl, uint32_t* sl) {
+    if (size < KHEAP_SMALL_BLOCK) {
+        // small blocks are spread linearly over the first list
+        *fl = 0;
+        *sl = size / (KHEAP_SMALL_BLOCK / KHEAP_SL_COUNT);
     } else {
-        hdr->free_next = free_head;
-        hdr->free_prev = free_head->free_prev;
-        free_head->free_prev->free_next = hdr;
-        free_head->free_prev = hdr;
-        free_head = hdr;
+        uint32_t msb = 63 - __builtin_clzl(size);
+        *sl = (size >> (msb - KHEAP_SL_LOG2)) ^ KHEAP_SL_COUNT;
+        *fl = msb - (KHEAP_FL_SHIFT - 1);
     }
 }
 
-static inline void freelist_remove(memblock_t* hdr) {
-    // verify freelist isn't empty
-    if (free_head == NULL) {
-        error("[freelist_remove] removal attempted on empty freelist.\n");
-        return;
+/*
+ * mapping_search
+ * finds the first free list whose blocks all fit @param size bytes
+ * @param size : rounded up to the lower bound of the next list
+ */
+static inline void mapping_search(size_t* size, uint32_t* fl, uint32_t* sl) {
+    if (*size >= KHEAP_SMALL_BLOCK) {
+        size_t round = ((size_t) 1 << (63 - __builtin_clzl(*size) - KHEAP_SL_LOG2)) - 1;
+        *size += round;
+        *size &= ~round;
     }
 
+    mapping_insert(*size, fl, sl);
+}
+
+/* utility freelist functions */
+static inline void freelist_insert(memblock_t* hdr) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(hdr), &fl, &sl);
+
+    // insert hdr at the head of its free list
+    memblock_t* head = free_lists[fl][sl];
+    hdr->free_next = head;
+    hdr->free_prev = NULL;
+    if (head != NULL)
+        head->free_prev = hdr;
+
+    free_lists[fl][sl] = hdr;
+    fl_bitmap |= (1ul << fl);
+    sl_bitmap[fl] |= (1u << sl);
+
+    // write boundary tags
+    hdr->size |= KHEAP_BLOCK_FREE;
+    block_footer(hdr) = block_size(hdr);
+    block_next(hdr)->size |= KHEAP_BLOCK_PREV_FREE;
+}
+
+static inline void freelist_remove(memblock_t* hdr) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(hdr), &fl, &sl);
+
     // verify hdr is actually free
     if (!is_free(hdr)) {
         error("[freelist_remove] hdr is not free.\n");
         return;
     }
 
-    // remove hdr from freelist
-    if (hdr->free_next == hdr && hdr->free_prev == hdr) {
-        // one elem in freelist (hdr is free_head)
-        if (hdr != free_head) {
-            error("[freelist_remove] one element in freelist, but it's not hdr\n");
-            return;
-        }
+    if (hdr->free_prev != NULL)
+        hdr->free_prev->free_next = hdr->free_next;
+    else
+        free_lists[fl][sl] = hdr->free_next;
 
-        // freelist is empty now
-        hdr->free_next = NULL;
-        hdr->free_prev = NULL;
-        free_head = NULL;
+    if (hdr->free_next != NULL)
+        hdr->free_next->free_prev = hdr->free_prev;
 
-    } else {
-        memblock_t* prev_hdr = hdr->free_prev;
-        memblock_t* next_hdr = hdr->free_next;
-
-        prev_hdr->free_next = next_hdr;
-        next_hdr->free_prev = prev_hdr;
-        hdr->free_next = NULL;
-        hdr->free_prev = NULL;
-
-        // hdr is free head, remove and replace free_head
-        if (hdr == free_head)
-            free_head = next_hdr;
+    // clear bitmaps of empty lists
+    if (free_lists[fl][sl] == NULL) {
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (sl_bitmap[fl] == 0)
+            fl_bitmap &= ~(1ul << fl);
     }
+
+    hdr->size &= ~((size_t) KHEAP_BLOCK_FREE);
+    block_next(hdr)->size &= ~((size_t) KHEAP_BLOCK_PREV_FREE);
 }
 
 /*
- * merge_right
- * merge memory block with block/memory on the right
- * @param header : header to merge right from
- * @return new header of merged blocks
+ * freelist_find
+ * finds a free block of at least @param size bytes with two bitmap scans
+ * @return header of free block (still in its free list) or NULL if there is none
  */
-static memblock_t* merge_right(memblock_t* header) {
-    // verify header
-    if (header == NULL) {
-        error("[merge_right] header is NULL.\n");
+static memblock_t* freelist_find(size_t size) {
+    uint32_t fl, sl;
+    mapping_search(&size, &fl, &sl);
+    if (fl >= KHEAP_FL_COUNT)
         return NULL;
-    }
 
-    // verify header is free
-    // if (!is_free(header)) {
-    //     error("[merge_right] merge_right attempt on non-free header.\n");
-    //     return NULL;
-    // }
+    // lists of larger blocks on the same first level
+    uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        // any list on a higher first level
+        uint64_t fl_map = fl_bitmap & (~0ul << (fl + 1));
+        if (fl_map == 0)
+            return NULL;
 
-    memblock_t* right_header = header->next;
+        fl = __builtin_ctzl(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
 
-    // block on the right is free
-    if (right_header != NULL && is_free(right_header)) {
-        // adjust size
-        header->size = (block_end_addr(right_header) - block_start_addr(header) + 1); 
+    return free_lists[fl][__builtin_ctz(sl_map)];
+}
 
-        // remove right block from block (header) list 
-        header->next = right_header->next;
-        if (right_header->next != NULL)
-            right_header->next->prev = header;
+/*
+ * merge_right
+ * merge memory block with the block on the right if it is free
+ * @param header : header to merge right from, not in a free list
+ * @return header of merged blocks
+ */
+static memblock_t* merge_right(memblock_t* header) {
+    memblock_t* right_header = block_next(header);
 
-        // remove right block from free list
+    if (is_free(right_header)) {
         freelist_remove(right_header);
-
-    } else { 
-        // merge any free mem between header and next block/end of kheap
-        if (right_header == NULL) 
-            header->size = VA_END - block_start_addr(header) + 1;
-        else 
-            header->size = ((vaddr_t) right_header) - block_start_addr(header);
+        header->size += HDR_SIZE + block_size(right_header);
+        header->size |= right_header->size & KHEAP_BLOCK_TRIMMED;
     } 
 
     return header;
@@ -147,127 +246,218 @@ static memblock_t* merge_right(memblock_t* header) {
 
 /*
  * merge_left
- * merge memory block with block/memory on the left
- * @param header : header to merge left from
- * @return new header of merged blocks
+ * merge memory block with the block on the left if it is free
+ * @param header : header to merge left from, not in a free list
+ * @return header of merged blocks
  */
 static memblock_t* merge_left(memblock_t* header) {
-    // verify header
-    if (header == NULL) {
-        error("[merge_right] header is NULL.\n");
-        return NULL;
+    if (is_prev_free(header)) {
+        memblock_t* left_header = block_prev(header);
+        freelist_remove(left_header);
+        left_header->size += HDR_SIZE + block_size(header);
+        left_header->size |= header->size & KHEAP_BLOCK_TRIMMED;
+        header = left_header;
     }
 
-    // verify header is free
-    if (!is_free(header)) {
-        error("[merge_right] merge_right attempt on non-free header.\n");
-        return NULL;
-    }
+    return header;
+}
 
-    memblock_t* left_header = header->prev;
+/* 
+ * merge
+ * merge memory block with the blocks on the left and right
+ * @param header : header to merge from
+ * @return header of merged blocks
+ */
+static inline memblock_t* merge(memblock_t* header) {
+    header = merge_right(header);
+    header = merge_left(header);
+    return header;
+}
 
-    if (left_header != NULL && is_free(left_header)) {
-        // adjust size
-        left_header->size = (block_end_addr(header) - block_start_addr(left_header) + 1); 
+/*
+ * split 
+ * shrinks the block of @param hdr to @param num_bytes, the rest becomes a new free block
+ * nothing is split off if the rest is too small to hold a block
+ * @param hdr : hdr of used block to split
+ * @param num_bytes : number of bytes, KHEAP_ALIGN aligned
+ */
+static void split(memblock_t* hdr, size_t num_bytes) {
+    size_t size = block_size(hdr);
 
-        // remove block from block (header) list 
-        left_header->next = header->next;
-        if (header->next != NULL)
-            header->next->prev = left_header;
+    // verify block has enough space to split
+    if (size < num_bytes + HDR_SIZE + MIN_BLOCK_SIZE)
+        return;
 
-        // remove header from free list
-        freelist_remove(header);
+    // create new header behind the shrunk block, pages the rest has lost stay with it
+    size_t trimmed = hdr->size & KHEAP_BLOCK_TRIMMED;
+    hdr->size = num_bytes | (hdr->size & KHEAP_BLOCK_FLAGS & ~KHEAP_BLOCK_TRIMMED);
+    memblock_t* new_hdr = block_next(hdr);
+    new_hdr->size = (size - num_bytes - HDR_SIZE) | trimmed;
 
-        header = left_header;
+    // the rest may border on a free block
+    freelist_insert(merge_right(new_hdr));
+}
 
-    } else {
-        // merge any free mem between header and beginning of kheap
-        if (left_header == NULL) {
-            // header must be block_head
-            if (header != block_head) {
-                error("[merge_left] no header on the left, but header is no head of block list\n");
-                return NULL;
-            }
+/*
+ * request_size
+ * @returns block size serving a request of @param size bytes
+ */
+static inline size_t request_size(size_t size) {
+    return MAX(ALIGN_UP(size, KHEAP_ALIGN), MIN_BLOCK_SIZE);
+}
 
-            // find new size of block
-            header->size = block_end_addr(header) - kheap_top - sizeof(memblock_t) + 1;
+/*
+ * kheap_map
+ * backs @param num_pages pages from @param start_page on with new page frames
+ * frames are allocated in batches of KHEAP_MAP_BATCH with pmm_alloc_bulk
+ * @param start_page : lowest page to map
+ * @param num_pages : number of pages to map
+ */
+static void kheap_map(vaddr_t start_page, size_t num_pages) {
+    paddr_t frames[KHEAP_MAP_BATCH];
+    vaddr_t curr_page = start_page;
 
-            // move header to beginning of free block
-            memblock_t* old_header = header;
-            header = (memblock_t*) kheap_top;
-            memmove(header, old_header, sizeof(memblock_t));
+    while (num_pages) {
+        size_t num = MIN(num_pages, KHEAP_MAP_BATCH);
+        pmm_alloc_bulk(PMM_ZONE_NORMAL, num, frames);
+        paging_map_frames(curr_page, frames, num, PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
 
-        } else {
-            // find new size of block
-            header->size = block_end_addr(header) - block_end_addr(left_header) - sizeof(memblock_t);
+        curr_page += num * PAGE_SIZE;
+        num_pages -= num;
+    }
+}
 
-            // move header to beginning of free block
-            memblock_t* old_header = header;
-            header = (memblock_t*) (block_end_addr(left_header) + 1);
-            memmove(header, old_header, sizeof(memblock_t));
+/*
+ * kheap_unmap
+ * unmaps [@param start, @param end) and collects the page frames backing it in @param unmapped
+ * NOTE: the page frames are only freed by kheap_release
+ * @param start : first page to unmap
+ * @param end : page behind the last page to unmap
+ * @param unmapped : collects the page frames and their invalidations
+ */
+static void kheap_unmap(vaddr_t start, vaddr_t end, unmapped_t* unmapped) {
+    paddr_t frames[KHEAP_MAP_BATCH];
+
+    // pages that already lost their page frame are skipped by paging_unmap_frames
+    for (vaddr_t curr_page = start; curr_page < end; ) {
+        size_t num_pages = MIN((end - curr_page) / PAGE_SIZE, KHEAP_MAP_BATCH);
+        size_t num = paging_unmap_frames(curr_page, num_pages, frames, &unmapped->batch);
+        for (size_t i = 0; i < num; i++) {
+            addr_to_page(frames[i])->private = unmapped->frames;
+            unmapped->frames = frames[i];
         }
-    }
 
-    return header;
+        unmapped->num += num;
+        curr_page += num_pages * PAGE_SIZE;
+    }
 }
 
-/* 
- * merge
- * merge memory block with block/memory on the left and right
- * @param header : header to merge from
- * @return new header of merged blocks
+/*
+ * kheap_release
+ * waits until every processor invalidated the pages of @param unmapped and gives their page frames back to the pmm
+ * frames are freed in batches of KHEAP_MAP_BATCH with pmm_free_bulk
+ * NOTE: the batch of @param unmapped must be flushed and no heap lock may be held
  */
-static inline memblock_t* merge(memblock_t* header) {
-    header = merge_right(header);
-    header = merge_left(header);
-    return header;
+static void kheap_release(unmapped_t* unmapped) {
+    paddr_t frames[KHEAP_MAP_BATCH];
+
+    tlb_batch_wait(&unmapped->batch);
+
+    while (unmapped->num) {
+        size_t num = MIN(unmapped->num, KHEAP_MAP_BATCH);
+        for (size_t i = 0; i < num; i++) {
+            page_t* page = addr_to_page(unmapped->frames);
+            frames[i] = unmapped->frames;
+            unmapped->frames = page->private;
+            page->private = 0;
+        }
+
+        pmm_free_bulk(frames, num);
+        unmapped->num -= num;
+    }
 }
 
 /*
- * split 
- * will split the free area specified by @param hdr into 2 areas.
- * @param hdr : hdr of free area to split
- * @param num_bytes : number of bytes 
- * @return header of new free area with at least @param num_bytes
+ * kheap_populate
+ * backs every page of [@param start, @param end) that lost its page frame with a new one
+ * @param start : first byte that must be backed
+ * @param end : byte behind the last byte that must be backed
  */
-static memblock_t* split(memblock_t* hdr, size_t num_bytes) {
-    // verify hdr is free and non-NULL
-    if (hdr == NULL) {
-        error("[split] hdr is NULL\n");
-        return NULL;
+static void kheap_populate(vaddr_t start, vaddr_t end) {
+    for (vaddr_t curr_page = ALIGN_DOWN(start, PAGE_SIZE); curr_page < end; curr_page += PAGE_SIZE) {
+        if (paging_translate(curr_page) == 0)
+            paging_map(curr_page, pmm_alloc(PMM_ZONE_NORMAL, 1), PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
     }
+}
+
+/*
+ * block_populate
+ * backs the part of @param hdr that is about to be used for @param num_bytes, the rest stays trimmed
+ * @param hdr : hdr of block taken from the free lists
+ * @param num_bytes : number of bytes the block will be split to
+ */
+static void block_populate(memblock_t* hdr, size_t num_bytes) {
+    if (!(hdr->size & KHEAP_BLOCK_TRIMMED))
+        return;
 
-    // align size request
-    num_bytes = ALIGN_UP(num_bytes, 8);
+    // include header and free list links of the block split off behind it
+    vaddr_t end = (vaddr_t) block_next(hdr);
+    if (end - block_start_addr(hdr) >= num_bytes + HDR_SIZE + MIN_BLOCK_SIZE)
+        end = block_start_addr(hdr) + num_bytes + HDR_SIZE + 2 * sizeof(void*);
+    else
+        hdr->size &= ~((size_t) KHEAP_BLOCK_TRIMMED);
 
-    // verify free block has enough space to split
-    // can only split if:
-    // (hdr->size + sizeof(memblock_t)) - (num_bytes + sizeof(memblock_t)) >= sizeof(memblock_t) + KHEAP_MIN_FREE_SIZE
-    if (hdr->size - num_bytes < sizeof(memblock_t) + KHEAP_MIN_FREE_SIZE)
-        return hdr;
+    kheap_populate((vaddr_t) hdr, end);
+}
 
-    // create new header
-    hdr->size = (block_end_addr(hdr) - num_bytes - sizeof(memblock_t) + 1) - block_start_addr(hdr);
-    memblock_t* new_hdr = (memblock_t*) (block_end_addr(hdr) + 1);
-    new_hdr->size = num_bytes;
+/*
+ * kheap_trim
+ * gives memory of the free block @param hdr back to the pmm after [@param start, @param end) was freed into it
+ * the heap shrinks until KHEAP_TRIM_KEEP free bytes are left at kheap_top, inner pages of large blocks
+ * are released around the freed range (so the cost follows the number of freed pages)
+ * NOTE: kheap_lock must be held
+ * @param hdr : hdr of free block
+ * @param start : first byte of the freed range
+ * @param end : byte behind the freed range
+ * @param unmapped : collects the page frames given back
+ */
+static void kheap_trim(memblock_t* hdr, vaddr_t start, vaddr_t end, unmapped_t* unmapped) {
+    vaddr_t block_end = (vaddr_t) block_next(hdr);
+
+    // shrink the heap, the block at kheap_top moves up
+    if ((vaddr_t) hdr == kheap_top && block_end - kheap_top > KHEAP_TRIM_KEEP + PAGE_SIZE) {
+        vaddr_t new_top = ALIGN_DOWN(block_end - KHEAP_TRIM_KEEP, PAGE_SIZE);
+        size_t trimmed = hdr->size & KHEAP_BLOCK_TRIMMED;
+
+        freelist_remove(hdr);
+        kheap_unmap(kheap_top, new_top, unmapped);
+        kheap_populate(new_top, new_top + sizeof(memblock_t));
+        kheap_top = new_top;
+
+        hdr = (memblock_t*) kheap_top;
+        hdr->size = (block_end - kheap_top - HDR_SIZE) | trimmed;
+        freelist_insert(hdr);
+    }
 
-    // add new header to blocklist
-    new_hdr->prev = hdr;
-    new_hdr->next = hdr->next;
-    hdr->next = new_hdr;
-    if (new_hdr->next != NULL)
-        new_hdr->next->prev = new_hdr;
+    if (block_size(hdr) < KHEAP_TRIM_THRESHOLD)
+        return;
 
-    // add new header to freelist
-    freelist_insert(new_hdr);
+    // inner pages, neighbours merged in have their header and footer pages inside the block now
+    vaddr_t first = ALIGN_UP(((vaddr_t) hdr) + sizeof(memblock_t), PAGE_SIZE);
+    vaddr_t last = ALIGN_DOWN((vaddr_t) &block_footer(hdr), PAGE_SIZE);
+    first = MAX(first, ALIGN_DOWN(start, PAGE_SIZE) - PAGE_SIZE);
+    if (end < last && last - end > 2 * PAGE_SIZE)
+        last = ALIGN_DOWN(end, PAGE_SIZE) + 2 * PAGE_SIZE;
 
-    return new_hdr;
+    if (first < last) {
+        kheap_unmap(first, last, unmapped);
+        hdr->size |= KHEAP_BLOCK_TRIMMED;
+    }
 }
 
 /* 
  * kheap_expand
  * will expand the kernel heap by @param num_pages
- * TODO: map pages globally
  * @param num_pages : number of pages to expand kernel heap by
  */
 static void kheap_expand(size_t num_pages) {
@@ -277,150 +467,378 @@ static void kheap_expand(size_t num_pages) {
         return;
     }
 
+    // make sure new kheap_top does not pass kheap_max
+    if (kheap_top - kheap_max < num_pages * PAGE_SIZE)
+        panic("[kheap_expand] kheap has expanded too much:\nkheap_top: 0x%lx\nkheap_max: 0x%lx\nnum_pages: %lu\n", kheap_top, kheap_max, num_pages);
+
     // map pages
-    vaddr_t curr_page = kheap_top - PAGE_SIZE;
-    for (size_t i = 0; i < num_pages; i++) {
-        paging_map(curr_page, pmm_alloc(PMM_ZONE_NORMAL, 1), PAGE_PRESENT | PAGE_WRITABLE);
-        curr_page -= PAGE_SIZE;
-    }
+    kheap_map(kheap_top - num_pages * PAGE_SIZE, num_pages);
 
     // calculate new kheap_top
     kheap_top -= num_pages * PAGE_SIZE;
 
-    // make sure new kheap_top does not pass kheap_max
-    if (kheap_top < kheap_max) 
-        panic("[kheap_expand] kheap has expanded too much:\nkheap_top: 0x%lx\nkheap_max: 0x%lx\nnum_pages: %lu\n", kheap_top, kheap_max, num_pages);
-
-    // create new memblock_t header
+    // setup new block in front of the old first block
     memblock_t* header = (memblock_t*) kheap_top;
+    header->size = num_pages * PAGE_SIZE - HDR_SIZE;
 
-    // setup new header as block_head
-    header->size = ((vaddr_t) block_head) - block_start_addr(header);
-    header->next = block_head;
-    header->prev = NULL;
-    block_head->prev = header;
-    block_head = header;
+    // merge right, in case next element in block list is also free
+    freelist_insert(merge_right(header));
+}
 
-    // setup new header as head of freelist
-    freelist_insert(header);
+/* 
+ * kheap_alloc
+ * allocates @param size bytes from the free lists, expanding the heap if no free block fits
+ * NOTE: kheap_lock must be held
+ * @return pointer to newly allocated area
+ */
+static void* kheap_alloc(size_t size) {
+    size = request_size(size);
 
-    // merge right, in case next element in block list is also free
-    header = merge_right(header);
+    memblock_t* hdr = freelist_find(size);
+    if (hdr == NULL) {
+        // expand heap by enough to hold a block of the next list up, a free first block is not taken into account
+        size_t new_size = size;
+        uint32_t fl, sl;
+        mapping_search(&new_size, &fl, &sl);
+        new_size += HDR_SIZE;
+
+        size_t new_pages = (new_size / PAGE_SIZE) + (new_size % PAGE_SIZE ? 1 : 0);
+        log("[kmalloc] expanding heap by %lu pages ...\n", new_pages);
+        kheap_expand(new_pages);
+        
+        hdr = freelist_find(size);
+        if (hdr == NULL)
+            panic("[kmalloc] no free block of 0x%lx bytes after expanding heap.", size);
+    }
+
+    freelist_remove(hdr);
+    block_populate(hdr, size);
+    split(hdr, size);
+    return (void*) block_start_addr(hdr);
 }
 
 /* 
- * kmalloc
+ * large_page
+ * @returns descriptor of the first page frame of large object @param ptr or NULL if @param ptr is none
+ * NOTE: large_lock must be held
+ */
+static page_t* large_page(void* ptr) {
+    paddr_t frame = paging_translate((vaddr_t) ptr);
+    if (frame == 0)
+        return NULL;
+
+    page_t* page = addr_to_page(frame);
+    return (page->owner == ptr) ? page : NULL;
+}
+
+/*
+ * large_alloc
+ * allocates a large object of @param size bytes in free slots of the large object region
+ * NOTE: large_lock only covers reserving the slots, the object is backed after it was dropped
+ * @return pointer to page aligned object or NULL if the region is full
+ */
+static void* large_alloc(size_t size) {
+    size_t num_pages = large_num_pages(size);
+    size_t num_slots = large_num_slots(num_pages);
+
+    uint64_t rflags = heap_lock(&large_lock);
+
+    size_t slot = bitmap_find_range(&large_slots, 0, 0, num_slots);
+    if (slot == (size_t) -1) {
+        spin_unlock_irqrestore(&large_lock, rflags);
+        error("[kmalloc] no room for large object of 0x%lx bytes\n", size);
+        return NULL;
+    }
+
+    // reserve slots, nobody else maps them until they are cleared again
+    vaddr_t start = large_slot_addr(slot);
+    bitmap_set_range(&large_slots, slot, num_slots);
+    spin_unlock_irqrestore(&large_lock, rflags);
+
+    // back the object and record it
+    kheap_map(start, num_pages);
+    page_t* page = addr_to_page(paging_translate(start));
+    page->owner = (void*) start;
+    page->private = num_pages;
+
+    return (void*) start;
+}
+
+/*
+ * large_free
+ * gives the page frames and slots of large object @param ptr back
+ */
+static void large_free(void* ptr) {
+    uint64_t rflags = heap_lock(&large_lock);
+
+    page_t* page = large_page(ptr);
+    if (page == NULL) {
+        spin_unlock_irqrestore(&large_lock, rflags);
+        error("[kfree] free request called on an unknown large object\n");
+        return;
+    }
+
+    size_t num_pages = page->private;
+    page->owner = NULL;
+    page->private = 0;
+
+    unmapped_t unmapped = UNMAPPED_INIT;
+    kheap_unmap((vaddr_t) ptr, (vaddr_t) ptr + num_pages * PAGE_SIZE, &unmapped);
+    bitmap_clear_range(&large_slots, large_addr_slot(ptr), large_num_slots(num_pages));
+    tlb_batch_flush(&unmapped.batch);
+
+    spin_unlock_irqrestore(&large_lock, rflags);
+    kheap_release(&unmapped);
+}
+
+/*
+ * large_realloc
+ * resizes large object @param ptr to @param size bytes without copying it:
+ *  1. pages are mapped or unmapped at its end, within its slots or the free slots behind them. If that fails,
+ *  2. its page frames are moved to new slots
+ * NOTE: large_lock only covers slots and unmapping, pages are mapped at the end after it was dropped
+ * @returns pointer to resized object or NULL upon failure
+ */
+static void* large_realloc(void* ptr, size_t size) {
+    unmapped_t unmapped = UNMAPPED_INIT;
+    uint64_t rflags = heap_lock(&large_lock);
+
+    page_t* page = large_page(ptr);
+    if (page == NULL) {
+        spin_unlock_irqrestore(&large_lock, rflags);
+        error("[krealloc] realloc request called on an unknown large object\n");
+        return NULL;
+    }
+
+    vaddr_t start = (vaddr_t) ptr;
+    size_t slot = large_addr_slot(start);
+    size_t old_pages = page->private;
+    size_t new_pages = large_num_pages(size);
+    size_t old_slots = large_num_slots(old_pages);
+    size_t new_slots = large_num_slots(new_pages);
+
+    if (new_pages <= old_pages) {
+        // shrink, give back pages and slots behind the object
+        kheap_unmap(start + new_pages * PAGE_SIZE, start + old_pages * PAGE_SIZE, &unmapped);
+        bitmap_clear_range(&large_slots, slot + new_slots, old_slots - new_slots);
+    } else {
+        if (new_slots > old_slots) {
+            // take the slots behind the object if they are free
+            size_t free_slots = 0;
+            while (slot + old_slots + free_slots < KHEAP_LARGE_SLOTS && free_slots < new_slots - old_slots
+                   && !bitmap_get(&large_slots, slot + old_slots + free_slots))
+                free_slots++;
+
+            if (free_slots == new_slots - old_slots) {
+                bitmap_set_range(&large_slots, slot + old_slots, free_slots);
+            } else {
+                size_t new_slot = bitmap_find_range(&large_slots, 0, 0, new_slots);
+                if (new_slot == (size_t) -1) {
+                    spin_unlock_irqrestore(&large_lock, rflags);
+                    error("[krealloc] no room for large object of 0x%lx bytes\n", size);
+                    return NULL;
+                }
+
+                // move page frames, the contents stay where they are and the old slots are invalidated with unmapped
+                vaddr_t new_start = large_slot_addr(new_slot);
+                bitmap_set_range(&large_slots, new_slot, new_slots);
+                paddr_t frames[KHEAP_MAP_BATCH];
+                for (size_t i = 0; i < old_pages; i += KHEAP_MAP_BATCH) {
+                    size_t num = paging_unmap_frames(start + i * PAGE_SIZE, MIN(old_pages - i, KHEAP_MAP_BATCH), frames, &unmapped.batch);
+                    paging_map_frames(new_start + i * PAGE_SIZE, frames, num, PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
+                }
+
+                bitmap_clear_range(&large_slots, slot, old_slots);
+                start = new_start;
+            }
+        }
+    }
+
+    tlb_batch_flush(&unmapped.batch);
+    spin_unlock_irqrestore(&large_lock, rflags);
+    kheap_release(&unmapped);
+
+    // back the pages the object grew by in its reserved slots and record it
+    if (new_pages > old_pages)
+        kheap_map(start + old_pages * PAGE_SIZE, new_pages - old_pages);
+
+    page->owner = (void*) start;
+    page->private = new_pages;
+    return (void*) start;
+}
+
+/* 
+ * __kmalloc
  * dynamically allocated memory for the kernel
  * @param size : number of bytes to allocate
  * @return pointer to newly allocated area
  */
-void* kmalloc(size_t size) {
+static void* __kmalloc(size_t size) {
     // verify size is not 0
     if (size == 0) {
         error("[kmalloc] size of 0 was requested from kheap\n");
         return NULL;
     }
 
-    // align up request to multiple of 8 bytes
-    size = ALIGN_UP(size, 8);
-
-    // search freelist for first free block
-    memblock_t* curr = free_head;
-    while (curr != NULL) {
-        // allocate only if block is >= aligned size
-        if (curr->size == size) {
-            freelist_remove(curr);
-            return (void*) block_start_addr(curr);
-
-        } else if (curr->size > size) {
-            memblock_t* new_hdr = split(curr, size);
-            freelist_remove(new_hdr);
-            return (void*) block_start_addr(new_hdr);
-        }
-        
-        curr = curr->free_next;
-        if (curr == free_head)
-            break;
-    }
+    // small requests are served by the slab size classes
+    if (size <= SLAB_MAX_SIZE)
+        return slab_alloc(size);
 
-    // no free block large enough found, expand heap enough to fit request
-    size_t new_size = size + sizeof(memblock_t);
-    size_t new_pages = (new_size / PAGE_SIZE) + (new_size % PAGE_SIZE ? 1 : 0);
+    // large requests get their own pages
+    if (size >= KHEAP_LARGE_MIN)
+        return large_alloc(size);
 
-    // allocate less memory if block_head is free (it'll be merged)
-    if (is_free(block_head)) {
-        new_size = size - block_head->size + sizeof(memblock_t);  
-        new_pages = (new_size / PAGE_SIZE) + (new_size % PAGE_SIZE ? 1 : 0);
-    }
+    uint64_t rflags = heap_lock(&kheap_lock);
+    void* ptr = kheap_alloc(size);
+    spin_unlock_irqrestore(&kheap_lock, rflags);
 
-    log("[kmalloc] expanding heap by %lu pages ...\n", new_pages);
-    kheap_expand(new_pages);
-    return kmalloc(size);
+    return ptr;
 }
 
 /* 
- * kfree
+ * __kfree
  * frees dynamically allocated memory 
- * @param size : number of bytes to allocate
- * @return pointer to newly allocated area
+ * @param ptr : pointer to allocated area
  */
-void kfree(void* ptr) {
+static void __kfree(void* ptr) {
+    if (is_large_obj(ptr)) {
+        large_free(ptr);
+        return;
+    }
+
+    if (is_slab_obj(ptr)) {
+        slab_free(ptr);
+        return;
+    }
+
     // get header
-    memblock_t* header = (memblock_t*) ((vaddr_t) ptr - sizeof(memblock_t));    
+    memblock_t* header = ptr_to_block(ptr);
     
+    uint64_t rflags = heap_lock(&kheap_lock);
+
     // verify header is in use
     if (is_free(header)) {
+        spin_unlock_irqrestore(&kheap_lock, rflags);
         error("[kfree] free request called on an already free memory block\n");
         return;
     }
 
-    // free memblock
+    // merge neighboring blocks and free them
+    vaddr_t start = (vaddr_t) header;
+    vaddr_t end = (vaddr_t) block_next(header);
+    header = merge(header);
     freelist_insert(header);
 
-    // merge neighboring blocks
-    header = merge(header);
+    // give memory back to the pmm
+    unmapped_t unmapped = UNMAPPED_INIT;
+    kheap_trim(header, start, end, &unmapped);
+    tlb_batch_flush(&unmapped.batch);
+
+    spin_unlock_irqrestore(&kheap_lock, rflags);
+    kheap_release(&unmapped);
 }
 
 /*
- * krealloc 
- * will expand an already dynamically allocated memory area by first
- *  1. trying to expand the existing memory area. If that fails, it will
+ * __krealloc 
+ * will resize an already dynamically allocated memory area by first
+ *  1. shrinking the area or growing it into a free block on its right. If that fails, it will
  *  2. create a new area of request size
  * Note that when falling back to method 2, the old memory
  * area will be freed and hence invalid. 
- * @param ptr : pointer to allocated memory that needs to be expanded
- * @param size : the new size the area must be expanded to
- * @returns pointer to newly expanded area or NULL upon failure
+ * @param ptr : pointer to allocated memory that needs to be resized
+ * @param size : the new size of the area
+ * @returns pointer to resized area or NULL upon failure
  */
-void* krealloc(void* ptr, size_t size) {
-    memblock_t* header = (memblock_t*) ((vaddr_t) ptr - sizeof(memblock_t));
+static void* __krealloc(void* ptr, size_t size) {
+    // large objects are remapped instead of copied
+    if (is_large_obj(ptr))
+        return large_realloc(ptr, size);
+
+    // slab objects are moved once they outgrow their size class
+    if (is_slab_obj(ptr)) {
+        size_t obj_size = slab_size(ptr);
+        if (size <= obj_size)
+            return ptr;
+
+        void* new_ptr = __kmalloc(size);
+        if (new_ptr == NULL)
+            return NULL;
+
+        memcpy(new_ptr, ptr, obj_size);
+        slab_free(ptr);
+        return new_ptr;
+    }
+
+    memblock_t* header = ptr_to_block(ptr);
+    size_t new_size = request_size(size);
+
+    uint64_t rflags = heap_lock(&kheap_lock);
 
     // verify header is in use
     if (is_free(header)) {
+        spin_unlock_irqrestore(&kheap_lock, rflags);
         error("[krealloc] realloc request called on a free memory block\n");
         return NULL;
     }
 
-    header = merge_right(header);
-
-    // check if merged header is large enough
-    if (header->size >= size) {
-        header = split(header, size);
-        return CAST(block_start_addr(header), void*);
+    // grow in place if the block on the right is free and large enough, large sizes move to a large object
+    size_t old_size = block_size(header);
+    memblock_t* right_header = block_next(header);
+    if (new_size > old_size && size < KHEAP_LARGE_MIN && is_free(right_header) && old_size + HDR_SIZE + block_size(right_header) >= new_size)
+        header = merge_right(header);
+
+    // check if block is large enough
+    if (block_size(header) >= new_size) {
+        block_populate(header, new_size);
+        split(header, new_size);
+        spin_unlock_irqrestore(&kheap_lock, rflags);
+        return ptr;
     }
 
+    spin_unlock_irqrestore(&kheap_lock, rflags);
+
     // allocate new area 
-    void* new_ptr = kmalloc(size);
+    void* new_ptr = __kmalloc(size);
     if (new_ptr == NULL)
         return NULL;
 
     // copy over data from old area then free it
-    memcpy(new_ptr, ptr, header->size);
-    kfree(ptr);
+    memcpy(new_ptr, ptr, old_size);
+    __kfree(ptr);
 
     return new_ptr;
 }
 
+/*
+ * kmalloc
+ * allocates @param size bytes, see __kmalloc
+ * NOTE: the kheap api records the caller with the profiler (KPROF_ENABLED)
+ */
+void* kmalloc(size_t size) {
+    void* ptr = __kmalloc(size);
+    kprof_alloc(__builtin_return_address(0), ptr, size);
+    return ptr;
+}
+
+/*
+ * kfree
+ * frees @param ptr, see __kfree
+ */
+void kfree(void* ptr) {
+    kprof_free(ptr);
+    __kfree(ptr);
+}
+
+/*
+ * krealloc
+ * resizes @param ptr to @param size bytes, see __krealloc
+ */
+void* krealloc(void* ptr, size_t size) {
+    void* new_ptr = __krealloc(ptr, size);
+    kprof_realloc(__builtin_return_address(0), ptr, new_ptr, size);
+    return new_ptr;
+}
+
 /* 
  * kheap_init
  * initializes head with @param num_pages pages
@@ -452,45 +870,45 @@ void kheap_init(struct stivale2_struct* handover, size_t num_pages) {
         panic("[kheap_init] kheap was initialized with too much memory:\nkheap_top: 0x%lx\nkheap_max: 0x%lx\nnum_pages: %lu\n", kheap_top, kheap_max, num_pages);
 
     // map pages
-    vaddr_t curr_page = VA_END - PAGE_SIZE + 1;
-    for (size_t i = 0; i < num_pages; i++) {
-        paging_map(curr_page, pmm_alloc(PMM_ZONE_NORMAL, 1), PAGE_PRESENT | PAGE_WRITABLE);
-        curr_page -= PAGE_SIZE;
-    }
+    kheap_map(kheap_top, num_pages);
 
-    // setup memblock list and freelist
-    block_head = (memblock_t*) kheap_top;
-    free_head = (memblock_t*) kheap_top;
-    block_head->size = (num_pages * PAGE_SIZE) - sizeof(memblock_t);
-    block_head->next = NULL;
-    block_head->prev = NULL;
-    free_head->free_next = free_head;
-    free_head->free_prev = free_head;
+    // setup one free block followed by the epilogue
+    memblock_t* header = (memblock_t*) kheap_top;
+    memblock_t* epilogue = (memblock_t*) (VA_END - HDR_SIZE + 1);
+    header->size = (num_pages * PAGE_SIZE) - 2 * HDR_SIZE;
+    epilogue->size = 0;
+    freelist_insert(header);
+
+    // slots of the large object region
+    if (bitmap_summary_size_bytes(&large_slots) > sizeof(large_summary_data))
+        panic("[kheap_init] large object slot summary does not fit 0x%lx bytes", sizeof(large_summary_data));
+    bitmap_summary_init(&large_slots, &large_summary, large_summary_data);
+
+    // small object caches
+    slab_init();
 }
 
 /* for debugging */
 void parse_blocklist(void) {
     info("parsing kheap block (header) list ...\n");
-    memblock_t* curr = block_head;
-    do {
-        if (curr == NULL)
-            break;
+    memblock_t* curr = (memblock_t*) kheap_top;
+    while (curr != NULL) {
+        log("[parse_blocklist] header addr: 0x%lx, size: 0x%lx, free?: %u\n", curr, block_size(curr), is_free(curr));
 
-        log("[parse_blocklist] header addr: 0x%lx, size: 0x%lx, free?: %u\n", curr, curr->size, is_free(curr));
+        // epilogue ends the heap
+        if (block_size(curr) == 0)
+            break;
 
-        curr = curr->next;
-    } while (curr != NULL);
+        curr = block_next(curr);
+    }
 }
 
 void parse_freelist(void) {
     info("parsing kheap freelist ...\n");
-    memblock_t* curr = free_head;
-    do {
-        if (curr == NULL)
-            break;
-
-        log("[parse_freelist] header addr: 0x%lx, size: 0x%lx\n", curr, curr->size);
-
-        curr = curr->free_next;
-    } while (curr != NULL && curr != free_head);
+    for (uint32_t fl = 0; fl < KHEAP_FL_COUNT; fl++) {
+        for (uint32_t sl = 0; sl < KHEAP_SL_COUNT; sl++) {
+            for (memblock_t* curr = free_lists[fl][sl]; curr != NULL; curr = curr->free_next)
+                log("[parse_freelist] list: %u/%u, header addr: 0x%lx, size: 0x%lx\n", fl, sl, curr, block_size(curr));
+        }
+    }
 }
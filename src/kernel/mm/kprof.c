@@ -0,0 +1,215 @@
+#include <mm/kprof.h>
+#include <log.h>
+
+/*
+ * General notes:
+ * - call sites and live objects are kept in fixed size open addressing tables, nothing is allocated
+ * - objects allocated while the live table is full are not tracked, their frees only count as untracked
+ * - lifetimes are measured in time stamp counter cycles
+ * - the profile is printed over serial with parse_profile
+*/
+
+#if KPROF_ENABLED
+
+#define kprof_hash(val, size)   ((((uint64_t) (val)) * 0x9e3779b97f4a7c15) >> (64 - __builtin_ctzl(size)))
+
+static kprof_site_t sites[KPROF_NUM_SITES];
+static kprof_live_t live[KPROF_NUM_LIVE];
+static size_t num_dropped = 0;                  /* requests of sites that did not fit the site table */
+static size_t num_untracked = 0;                /* frees and reallocs of objects missing from the live table */
+static spinlock_t kprof_lock = SPINLOCK_INIT;
+
+/*
+ * site_get
+ * @returns statistics of call site @param site or NULL if the site table is full
+ */
+static kprof_site_t* site_get(vaddr_t site) {
+    size_t idx = kprof_hash(site, KPROF_NUM_SITES);
+    for (size_t i = 0; i < KPROF_NUM_SITES; i++) {
+        kprof_site_t* curr = &sites[(idx + i) % KPROF_NUM_SITES];
+        if (curr->site == site)
+            return curr;
+
+        if (curr->site == 0) {
+            curr->site = site;
+            return curr;
+        }
+    }
+
+    num_dropped++;
+    return NULL;
+}
+
+/*
+ * site_record
+ * counts a request of @param size bytes in the size histogram and byte count of @param site
+ */
+static void site_record(kprof_site_t* site, size_t size) {
+    size_t bucket = (size > 1) ? 63 - __builtin_clzl(size) : 0;
+    site->hist[MIN(bucket, KPROF_NUM_BUCKETS - 1)]++;
+    site->bytes += size;
+}
+
+/*
+ * live_insert
+ * tracks object @param ptr of @param size bytes allocated by @param site at @param tsc
+ */
+static void live_insert(void* ptr, size_t size, uint64_t tsc, kprof_site_t* site) {
+    size_t idx = kprof_hash((vaddr_t) ptr >> 3, KPROF_NUM_LIVE);
+    for (size_t i = 0; i < KPROF_NUM_LIVE; i++) {
+        kprof_live_t* curr = &live[(idx + i) % KPROF_NUM_LIVE];
+        if (curr->ptr == NULL) {
+            *curr = (kprof_live_t) { .ptr = ptr, .size = size, .tsc = tsc, .site = site };
+            site->live_bytes += size;
+            return;
+        }
+    }
+}
+
+/*
+ * live_remove
+ * stops tracking object @param ptr, later entries of its probe sequence are shifted back
+ * @param entry : filled with the removed entry
+ * @returns whether @param ptr was tracked
+ */
+static bool live_remove(void* ptr, kprof_live_t* entry) {
+    size_t idx = kprof_hash((vaddr_t) ptr >> 3, KPROF_NUM_LIVE);
+    size_t hole = (size_t) -1;
+    for (size_t i = 0; i < KPROF_NUM_LIVE; i++) {
+        size_t curr = (idx + i) % KPROF_NUM_LIVE;
+        if (live[curr].ptr == NULL)
+            return false;
+
+        if (live[curr].ptr == ptr) {
+            hole = curr;
+            break;
+        }
+    }
+
+    if (hole == (size_t) -1)
+        return false;
+
+    *entry = live[hole];
+    entry->site->live_bytes -= entry->size;
+
+    // backward shift deletion, entries may not end up in front of their home slot
+    for (size_t curr = (hole + 1) % KPROF_NUM_LIVE; live[curr].ptr != NULL; curr = (curr + 1) % KPROF_NUM_LIVE) {
+        size_t home = kprof_hash((vaddr_t) live[curr].ptr >> 3, KPROF_NUM_LIVE);
+        if (((curr - home) % KPROF_NUM_LIVE) >= ((curr - hole) % KPROF_NUM_LIVE)) {
+            live[hole] = live[curr];
+            hole = curr;
+        }
+    }
+
+    live[hole].ptr = NULL;
+    return true;
+}
+
+/*
+ * kprof_alloc
+ * records allocation @param ptr of @param size bytes requested from @param site
+ */
+void kprof_alloc(void* site, void* ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+
+    uint64_t tsc;
+    rdtsc(tsc);
+
+    uint64_t rflags = spin_lock_irqsave(&kprof_lock);
+    kprof_site_t* curr = site_get((vaddr_t) site);
+    if (curr != NULL) {
+        curr->num_allocs++;
+        site_record(curr, size);
+        live_insert(ptr, size, tsc, curr);
+    }
+    spin_unlock_irqrestore(&kprof_lock, rflags);
+}
+
+/*
+ * kprof_realloc
+ * records resize of @param old_ptr to @param new_ptr of @param size bytes requested from @param site
+ * NOTE: the object keeps its allocating site and time stamp
+ */
+void kprof_realloc(void* site, void* old_ptr, void* new_ptr, size_t size) {
+    if (new_ptr == NULL)
+        return;
+
+    uint64_t rflags = spin_lock_irqsave(&kprof_lock);
+    kprof_site_t* curr = site_get((vaddr_t) site);
+    if (curr != NULL) {
+        curr->num_reallocs++;
+        site_record(curr, size);
+    }
+
+    kprof_live_t entry;
+    if (live_remove(old_ptr, &entry))
+        live_insert(new_ptr, size, entry.tsc, entry.site);
+    else
+        num_untracked++;
+    spin_unlock_irqrestore(&kprof_lock, rflags);
+}
+
+/*
+ * kprof_free
+ * records free of @param ptr with its lifetime
+ */
+void kprof_free(void* ptr) {
+    uint64_t tsc;
+    rdtsc(tsc);
+
+    uint64_t rflags = spin_lock_irqsave(&kprof_lock);
+    kprof_live_t entry;
+    if (live_remove(ptr, &entry)) {
+        uint64_t lifetime = tsc - entry.tsc;
+        entry.site->num_frees++;
+        entry.site->lifetime += lifetime;
+        entry.site->max_lifetime = MAX(entry.site->max_lifetime, lifetime);
+    } else {
+        num_untracked++;
+    }
+    spin_unlock_irqrestore(&kprof_lock, rflags);
+}
+
+/* for debugging */
+void parse_profile(void) {
+    info("parsing kheap profile ...\n");
+
+    uint64_t rflags = spin_lock_irqsave(&kprof_lock);
+
+    // sites by bytes requested, largest first
+    kprof_site_t* sorted[KPROF_NUM_SITES];
+    size_t num = 0;
+    for (size_t i = 0; i < KPROF_NUM_SITES; i++) {
+        if (sites[i].site == 0)
+            continue;
+
+        size_t j = num++;
+        for ( ; j > 0 && sorted[j - 1]->bytes < sites[i].bytes; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = &sites[i];
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        kprof_site_t* curr = sorted[i];
+        log("[parse_profile] site 0x%lx: allocs: %lu, reallocs: %lu, frees: %lu, bytes: %lu, live bytes: %lu, avg lifetime: %lu, max lifetime: %lu\n",
+            curr->site, curr->num_allocs, curr->num_reallocs, curr->num_frees, curr->bytes, curr->live_bytes,
+            curr->num_frees ? curr->lifetime / curr->num_frees : 0, curr->max_lifetime);
+
+        for (size_t bucket = 0; bucket < KPROF_NUM_BUCKETS; bucket++) {
+            if (curr->hist[bucket])
+                log("[parse_profile]     %s%lu bytes: %lu\n", (bucket + 1 == KPROF_NUM_BUCKETS) ? ">= " : "", 1ul << bucket, curr->hist[bucket]);
+        }
+    }
+
+    log("[parse_profile] dropped: %lu, untracked: %lu\n", num_dropped, num_untracked);
+    spin_unlock_irqrestore(&kprof_lock, rflags);
+}
+
+#else
+
+void parse_profile(void) {
+    info("kheap profiling is disabled (KPROF_ENABLED)\n");
+}
+
+#endif
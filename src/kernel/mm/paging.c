@@ -1,6 +1,60 @@
 #include <mm/paging.h>
 #include <mm/pmm.h>
 #include <intr/interrupt.h>
+#include <mm/tlb.h>
+#include <cpu/smp.h>
+#include <ds/bitmap.h>
+
+/* kernel page tables, all address spaces share their mappings */
+addrspace_t kernel_space = { .pml4_table = NULL, .pcid = PAGING_KERNEL_PCID, .tlb_cpus = 0, .active_cpus = 0 };
+
+/* set once the kernel page tables are loaded, memory above 4 GiB is only in the HHDM from then on */
+bool paging_ready = false;
+
+/* whether 1 GiB pages are supported, queried once in paging_init */
+static bool page_1gb = false;
+
+/* address space loaded on each processor, NULL for kernel_space */
+static addrspace_t* current_spaces[SMP_MAX_CPUS];
+
+/* pcids handed out to address spaces, a set bit is a pcid in use */
+static bool pcids_enabled = false;
+static uint64_t pcids_data[PAGING_NUM_PCIDS / BITMAP_WORD_BITS];
+static bitmap_t pcids = { .size = PAGING_NUM_PCIDS, .data = pcids_data };
+static spinlock_t pcid_lock = SPINLOCK_INIT;
+
+/*
+ * paging_map_memmap
+ * maps physical memory from PAGE_SIZE up to the end of @param memmap at @param offset
+ * large pages are only used inside usable, bootloader reclaimable and kernel entries, mmio, reserved
+ * ranges and the holes between entries are mapped with 4 KiB pages so no large page spans memory types
+ * @param pml4_table: the physical address of pml4 table to map addresses at
+ * @param memmap: bootloader memory map, entries are sorted by base address
+ * @param offset: virtual address physical address 0 is mapped at
+ * @param flags: flags to create the mappings with
+ */
+static void paging_map_memmap(pml_table_t* pml4_table, struct stivale2_struct_tag_memmap* memmap, vaddr_t offset, uint64_t flags) {
+    paddr_t cursor = PAGE_SIZE;
+    for (uint64_t i = 0; i < memmap->entries; i++) {
+        struct stivale2_mmap_entry entry = memmap->memmap[i];
+        paddr_t start = MAX(ALIGN_DOWN(entry.base, PAGE_SIZE), cursor);
+        paddr_t end = ALIGN_UP(entry.base + entry.length, PAGE_SIZE);
+        if (end <= start)
+            continue;
+
+        // hole before the entry
+        if (cursor < start)
+            __paging_maps(pml4_table, offset + cursor, cursor, (start - cursor) / PAGE_SIZE, flags);
+
+        uint64_t num = (end - start) / PAGE_SIZE;
+        if (entry.type == MEM_USABLE || entry.type == MEM_BOOT_RECLAIM || entry.type == MEM_KERNEL)
+            __paging_maps_large(pml4_table, offset + start, start, num, flags);
+        else
+            __paging_maps(pml4_table, offset + start, start, num, flags);
+
+        cursor = end;
+    }
+}
 
 /* 
  * paging_init
@@ -37,12 +91,14 @@ void paging_init(struct stivale2_struct* handover) {
     // register page fault interrupt handler
     register_intr_handler(&wrapper_page_fault_intr_handler, PAGE_FAULT_IRQ_VEC);
     
+    // large page support is needed by __paging_maps_large below
+    page_1gb = cpuid_page_1gb();
+
     // create pml4 table
     pml_table_t* pml4_table = paging_create();
     log("[paging_init] pml4_table: 0x%lx\n", pml4_table);
 
-    // map pmrs
-    // TODO: make these global pages
+    // map pmrs, the kernel image is the same in every address space
     paddr_t pbase = kernel_base->physical_base_address;
     vaddr_t vbase = kernel_base->virtual_base_address;
     for (uint64_t i = 0; i < pmrs->entries; i++) {
@@ -54,32 +110,50 @@ void paging_init(struct stivale2_struct* handover) {
         vaddr_t ventry = entry.base;
         paddr_t pentry = pbase + (ventry - vbase);
         uint64_t num = entry.length / PAGE_SIZE;
-        uint64_t flags = PAGE_PRESENT;
+        uint64_t flags = PAGE_PRESENT | PAGE_GLOBAL;
 
         if (entry.permissions & STIVALE2_PMR_WRITABLE) 
             flags |= PAGE_WRITABLE;
 
         // log("[kvm_init] ventry 0x%lx, pentry 0x%lx, num 0x%lx, flags 0x%lx\n", ventry, pentry, num, flags);
-        __paging_maps(pml4_table, ventry, pentry, num, flags);
+        __paging_maps_large(pml4_table, ventry, pentry, num, flags);
     }
 
-    // direct map physical addr space 
-    // map each region of memmap 
-    // map each region of memmap with 0xffff800000000000 offset, TODO: make these global pages
-    paddr_t mem_start = PAGE_SIZE;
-    paddr_t mem_end = memmap->memmap[memmap->entries - 1].base + memmap->memmap[memmap->entries - 1].length;
-    uint64_t mem_length = mem_end - mem_start;
+    // direct map physical addr space, identity map is not global
+    // map each region of memmap with 0xffff800000000000 offset as global pages
+    paging_map_memmap(pml4_table, memmap, 0, PAGE_PRESENT | PAGE_WRITABLE);
+    paging_map_memmap(pml4_table, memmap, VA_HHDM, PAGE_PRESENT | PAGE_WRITABLE | PAGE_GLOBAL);
 
-    if (mem_length % PAGE_SIZE)
-        warning("[paging_init] mem_length is not a multiple of page size: 0x%lx\n", mem_length);
-
-    uint64_t num_pages = mem_length / PAGE_SIZE;
-
-    __paging_maps(pml4_table, mem_start, mem_start, num_pages, PAGE_PRESENT | PAGE_WRITABLE);
-    __paging_maps(pml4_table, P2V(mem_start), mem_start, num_pages, PAGE_PRESENT | PAGE_WRITABLE);
+    // kernel pml4 entries are copied into every address space, create all of them now so they never change
+    for (size_t i = PAGE_TABLE_ENTRIES / 2; i < PAGE_TABLE_ENTRIES; i++) {
+        pml_entry_t* pentry = &pml4_table->entries[i];
+        if (!paging_check_flags(pentry, PAGE_PRESENT)) {
+            paging_set_paddr(pentry, (paddr_t) paging_create());
+            paging_set_flags(pentry, PAGE_PRESENT);
+        }
+    }
 
     // load new mappings to cr3
+    kernel_space.pml4_table = pml4_table;
     load_cr3(pml4_table);
+
+    // pcids can only be enabled while cr3 holds pcid 0
+    // kernel mappings are only shared between pcids as global pages, without them kernel shootdowns would miss other pcids
+    uint64_t cr4;
+    dump_cr4(cr4);
+    if (cpuid_pge())
+        cr4 |= CR4_PGE;
+    if (cpuid_pcid() && (cr4 & CR4_PGE)) {
+        cr4 |= CR4_PCIDE;
+        pcids_enabled = true;
+        bitmap_set(&pcids, PAGING_KERNEL_PCID);
+    }
+    load_cr4(cr4);
+
+    // pmm_init_deferred may reach memory above 4 GiB through the HHDM from now on
+    __atomic_store_n(&paging_ready, true, __ATOMIC_RELEASE);
+
+    log("[paging_init] global pages: %s, pcids: %s\n", (cr4 & CR4_PGE) ? "enabled" : "disabled", pcids_enabled ? "enabled" : "disabled");
 }
 
 /*
@@ -139,6 +213,15 @@ static inline uint64_t paging_vaddr_idx(vaddr_t vaddr, uint8_t level) {
     return (vaddr >> (PAGE_IDX_SIZE * level + PAGE_OFFSET_SIZE)) & PAGE_IDX_MASK;
 }
 
+/* 
+ * paging_level_pages
+ * returns the number of 4 KiB pages covered by one entry of the given level
+ * @param level: pml level
+ */
+static inline uint64_t paging_level_pages(uint8_t level) {
+    return (uint64_t) 1 << (PAGE_IDX_SIZE * level);
+}
+
 /* 
  * paging_cr3
  * returns the physical address of the pml4 table currently in cr3
@@ -181,13 +264,26 @@ static pml_entry_t* paging_walk(pml_table_t* pml4_table, vaddr_t vaddr, uint8_t
         if (i == level) 
             return pentry;
 
+        // a large page maps the whole range of the entry, there is no table below it
+        if (paging_check_flags(pentry, PAGE_PRESENT | PAGE_PSIZE)) {
+            error("[paging_walk] vaddr 0x%lx is mapped by a large page at level %u\n", vaddr, i);
+            return NULL;
+        }
+
         // go to next level
         if (paging_check_flags(pentry, PAGE_PRESENT)) 
             curr_table = (pml_table_t*) paging_get_paddr(pentry);
         else if (create) {
+            // processors mapping disjoint ranges may create the same table, the first one installs it
             pml_table_t* child_table = paging_create(); 
-            paging_set_paddr(pentry, (paddr_t) child_table);
-            paging_set_flags(pentry, PAGE_PRESENT);
+            pml_entry_t expected = 0;
+            pml_entry_t entry = 0;
+            paging_set_paddr(&entry, (paddr_t) child_table);
+            paging_set_flags(&entry, PAGE_PRESENT);
+            if (!__atomic_compare_exchange_n(pentry, &expected, entry, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                pmm_free((paddr_t) child_table, 1);
+                child_table = (pml_table_t*) paging_get_paddr(&expected);
+            }
             curr_table = child_table; 
         } else {
             error("[paging_walk] A non-present entry was found at level %u for vaddr 0x%lx\n", level, vaddr);
@@ -199,14 +295,40 @@ static pml_entry_t* paging_walk(pml_table_t* pml4_table, vaddr_t vaddr, uint8_t
     return NULL;
 }
 
+/*
+ * paging_lookup
+ * finds the entry mapping @param vaddr without creating tables
+ * NOTE: unlike paging_walk, missing tables are not an error
+ * @param pml4_table: the physical address of pml4 table to start parsing at
+ * @param vaddr: vaddr to find the entry for
+ * @param level: set to the level of the returned entry, or of the non-present entry if NULL is returned
+ * @returns large page entry, pml1 entry or NULL if a table on the way is not present
+ */
+static pml_entry_t* paging_lookup(pml_table_t* pml4_table, vaddr_t vaddr, uint8_t* level) {
+    pml_table_t* curr_table = pml4_table;
+    for (uint8_t i = PML4; i > PML1; i--) {
+        pml_entry_t* pentry = &curr_table->entries[paging_vaddr_idx(vaddr, i)];
+        *level = i;
+        if (!paging_check_flags(pentry, PAGE_PRESENT))
+            return NULL;
+
+        if (paging_check_flags(pentry, PAGE_PSIZE))
+            return pentry;
+
+        curr_table = (pml_table_t*) paging_get_paddr(pentry);
+    }
+
+    *level = PML1;
+    return &curr_table->entries[paging_vaddr_idx(vaddr, PML1)];
+}
+
 /*
  * paging_create
  * Creates pml table on any level
+ * NOTE: tables come from the pre-zeroed frame pool, no clearing on the map path
  */
 inline pml_table_t* paging_create(void) {
-    pml_table_t* ptable = (pml_table_t*) pmm_alloc(PMM_ZONE_NORMAL, 1);
-    memset(ptable, 0, sizeof(ptable));
-    return ptable;
+    return (pml_table_t*) pmm_alloc_zeroed(PMM_ZONE_NORMAL, 1);
 }
 
 /*
@@ -266,6 +388,38 @@ void __paging_map(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_
     paging_set_paddr(pentry, paddr);
 }
 
+/*
+ * paging_map_range
+ * maps @param num pages from @param vaddr on with @param flags, pml1 tables are only looked up
+ * when the range crosses into the next one
+ * @param pml4_table: the physical address of pml4 table to map addresses at
+ * @param vaddr: 4 KiB aligned virtual address to map
+ * @param paddr: 4 KiB aligned physical address to map the range to contiguously, unused if @param frames is given
+ * @param frames: page frame for each page, NULL to map to @param paddr
+ * @param num: the number of pages to map
+ * @param flags: flags to create the mappings with
+ */
+static void paging_map_range(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, const paddr_t* frames, uint64_t num, uint64_t flags) {
+    pml_entry_t* pentry = NULL;
+    for (uint64_t i = 0; i < num; i++, pentry++, vaddr += PAGE_SIZE) {
+        if (pentry == NULL || paging_vaddr_idx(vaddr, PML1) == 0) {
+            pentry = paging_walk(pml4_table, vaddr, PML1, true);
+            if (pentry == NULL)
+                return;
+        }
+
+        paddr_t curr = (frames != NULL) ? frames[i] : paddr + i * PAGE_SIZE;
+
+        // there is already an existing mapping, skip page
+        if (*pentry & PAGE_PRESENT) {
+            error("[paging_map_range] request to map vaddr 0x%lx to paddr 0x%lx but vaddr was already mapped to 0x%lx.\n", vaddr, curr, paging_get_paddr(pentry));
+            continue;
+        }
+
+        *pentry = (curr & PAGE_ADDR) | flags;
+    }
+}
+
 /*
  * __paging_maps
  * maps @param num pages from @param vaddr to @param paddr with @param flags
@@ -276,24 +430,144 @@ void __paging_map(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_
  * @param flags: flags to create the mapping with
  */
 void __paging_maps(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags) {
-    for (uint64_t i = 0; i < num; i++) {
-        __paging_map(pml4_table, vaddr, paddr, flags);
-        vaddr += PAGE_SIZE;
-        paddr += PAGE_SIZE;
+    // verify pml4 table is valid
+    if (pml4_table == NULL) {
+        error("[__paging_maps] pml4 table is null\n");
+        return;
+    }
+
+    // verify flags do not overlap the address
+    if (flags & PAGE_ADDR) {
+        error("[__paging_maps] flags 0x%lx overlap the physical address\n", flags);
+        return;
+    }
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[__paging_maps] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    // verify paddr is 4KiB aligned
+    if (paddr % PAGE_SIZE) {
+        warning("[__paging_maps] paddr is not 4 KiB aligned, paddr: %lx\n", paddr);
+        paddr = ALIGN_DOWN(paddr, PAGE_SIZE);
+    }
+
+    paging_map_range(pml4_table, vaddr, paddr, NULL, num, flags);
+}
+
+/*
+ * __paging_map_frames
+ * maps @param num pages from @param vaddr to the page frames in @param frames with @param flags
+ * @param pml4_table: the physical address of pml4 table to map addresses at
+ * @param vaddr: virtual address to map 
+ * @param frames: 4 KiB aligned page frame for each page
+ * @param num: the number of pages to map
+ * @param flags: flags to create the mapping with
+ */
+void __paging_map_frames(pml_table_t* pml4_table, vaddr_t vaddr, const paddr_t* frames, uint64_t num, uint64_t flags) {
+    // verify pml4 table is valid
+    if (pml4_table == NULL) {
+        error("[__paging_map_frames] pml4 table is null\n");
+        return;
+    }
+
+    // verify flags do not overlap the address
+    if (flags & PAGE_ADDR) {
+        error("[__paging_map_frames] flags 0x%lx overlap the physical address\n", flags);
+        return;
+    }
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[__paging_map_frames] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    paging_map_range(pml4_table, vaddr, 0, frames, num, flags);
+}
+
+/*
+ * __paging_maps_large
+ * maps @param num pages from @param vaddr to @param paddr with @param flags using the largest pages possible
+ * 1 GiB (if supported) and 2 MiB pages are used where @param vaddr and @param paddr are aligned to them,
+ * the unaligned edges fall back to 4 KiB pages
+ * NOTE: large pages cannot be unmapped in parts, only use this for ranges that stay mapped as a whole
+ * @param pml4_table: the physical address of pml4 table to map addresses at
+ * @param vaddr: virtual address to map 
+ * @param paddr: physical address to map to
+ * @param num: the number of 4 KiB pages to map
+ * @param flags: flags to create the mappings with
+ */
+void __paging_maps_large(pml_table_t* pml4_table, vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags) {
+    // verify pml4 table is valid
+    if (pml4_table == NULL) {
+        error("[__paging_maps_large] pml4 table is null\n");
+        return;
+    }
+
+    // verify flags do not overlap the address
+    if (flags & PAGE_ADDR) {
+        error("[__paging_maps_large] flags 0x%lx overlap the physical address\n", flags);
+        return;
+    }
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[__paging_maps_large] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    // verify paddr is 4KiB aligned
+    if (paddr % PAGE_SIZE) {
+        warning("[__paging_maps_large] paddr is not 4 KiB aligned, paddr: %lx\n", paddr);
+        paddr = ALIGN_DOWN(paddr, PAGE_SIZE);
+    }
+
+    uint8_t max_level = page_1gb ? PML3 : PML2;
+    while (num) {
+        // largest page both addresses are aligned to that fits in the rest of the range
+        uint8_t level = max_level;
+        while (level > PML1 && (((vaddr | paddr) / PAGE_SIZE) % paging_level_pages(level) || num < paging_level_pages(level)))
+            level--;
+
+        uint64_t count = paging_level_pages(level);
+        if (level == PML1) {
+            // 4 KiB pages up to the end of the pml1 table
+            count = MIN(num, PAGE_TABLE_ENTRIES - paging_vaddr_idx(vaddr, PML1));
+            paging_map_range(pml4_table, vaddr, paddr, NULL, count, flags);
+        } else {
+            pml_entry_t* pentry = paging_walk(pml4_table, vaddr, level, true);
+            if (pentry == NULL)
+                return;
+
+            // there is already a mapping or table, skip page
+            if (paging_check_flags(pentry, PAGE_PRESENT))
+                error("[__paging_maps_large] request to map large page at vaddr 0x%lx but vaddr was already mapped.\n", vaddr);
+            else
+                *pentry = (paddr & PAGE_ADDR) | flags | PAGE_PSIZE;
+        }
+
+        vaddr += count * PAGE_SIZE;
+        paddr += count * PAGE_SIZE;
+        num -= count;
     }
 }
 
 /*
  * __paging_unmap
  * unmaps @param vaddr to @param paddr 
+ * NOTE: large pages cannot be unmapped in parts, a vaddr covered by one is left mapped
  * @param pml4_table: the physical address of pml4 table to map addresses at
  * @param vaddr: virtual address to unmap 
+ * @returns whether a page was unmapped
  */
-void __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr) {
+bool __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr) {
     // verify pml4 table is valid
     if (pml4_table == NULL) {
         error("[__paging_unmap] pml4 table is null\n");
-        return;
+        return false;
     }
 
     // verify vaddr is 4KiB aligned
@@ -302,9 +576,72 @@ void __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr) {
         vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
     }
 
-    // get pml entry
-    pml_entry_t* pentry = paging_walk(pml4_table, vaddr, PML1, false);
+    // get pml entry, nothing to unmap without a table or page
+    uint8_t level;
+    pml_entry_t* pentry = paging_lookup(pml4_table, vaddr, &level);
+    if (pentry == NULL || !paging_check_flags(pentry, PAGE_PRESENT))
+        return false;
+
+    if (level > PML1) {
+        error("[__paging_unmap] vaddr 0x%lx is part of a large page, it cannot be unmapped in parts\n", vaddr);
+        return false;
+    }
+
     *pentry = 0;
+    return true;
+}
+
+/*
+ * paging_unmap_range
+ * unmaps @param num pages from @param vaddr on, pml1 tables are only looked up when the range
+ * crosses into the next one and ranges without a table are skipped as a whole
+ * large pages are only unmapped if the range covers them entirely
+ * NOTE: the tlb is left alone, callers invalidate the whole range at once afterwards
+ * @param pml4_table: the physical address of pml4 table to unmap addresses at
+ * @param vaddr: 4 KiB aligned virtual address to unmap
+ * @param num: number of pages to unmap
+ * @param frames: filled with the page frames that were unmapped, may be NULL
+ * @returns number of pages that were mapped
+ */
+static uint64_t paging_unmap_range(pml_table_t* pml4_table, vaddr_t vaddr, uint64_t num, paddr_t* frames) {
+    uint64_t num_unmapped = 0;
+    uint64_t i = 0;
+    while (i < num) {
+        // pages up to the end of the range covered by the entry found
+        uint8_t level;
+        pml_entry_t* pentry = paging_lookup(pml4_table, vaddr, &level);
+        uint64_t span = paging_level_pages(level);
+        uint64_t count = MIN(num - i, span - (vaddr / PAGE_SIZE) % span);
+
+        if (pentry != NULL && level > PML1) {
+            // large pages are unmapped whole or not at all
+            if (count < span) {
+                error("[paging_unmap_range] vaddr 0x%lx is part of a large page, it cannot be unmapped in parts\n", vaddr);
+            } else {
+                for (uint64_t j = 0; frames != NULL && j < span; j++)
+                    frames[num_unmapped + j] = paging_get_paddr(pentry) + j * PAGE_SIZE;
+
+                *pentry = 0;
+                num_unmapped += span;
+            }
+        }
+
+        for (uint64_t j = 0; pentry != NULL && level == PML1 && j < count; j++, pentry++) {
+            if (!(*pentry & PAGE_PRESENT))
+                continue;
+
+            if (frames != NULL)
+                frames[num_unmapped] = paging_get_paddr(pentry);
+
+            *pentry = 0;
+            num_unmapped++;
+        }
+
+        vaddr += count * PAGE_SIZE;
+        i += count;
+    }
+
+    return num_unmapped;
 }
 
 /*
@@ -315,10 +652,62 @@ void __paging_unmap(pml_table_t* pml4_table, vaddr_t vaddr) {
  * @parama num: number pages to unmap
  */
 void __paging_unmaps(pml_table_t* pml4_table, vaddr_t vaddr, uint64_t num) {
-    for (uint64_t i = 0; i < num; i++) {
-        __paging_unmap(pml4_table, vaddr);
-        vaddr += PAGE_SIZE;
+    // verify pml4 table is valid
+    if (pml4_table == NULL) {
+        error("[__paging_unmaps] pml4 table is null\n");
+        return;
     }
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[__paging_unmaps] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    paging_unmap_range(pml4_table, vaddr, num, NULL);
+}
+
+/*
+ * __paging_unmap_frames
+ * unmaps @param num pages from @param vaddr and collects the page frames they were mapped to
+ * @param pml4_table: the physical address of pml4 table to unmap addresses at
+ * @param vaddr: virtual address to unmap
+ * @param num: number of pages to unmap
+ * @param frames: filled with the page frames of the pages that were mapped, room for @param num frames
+ * @returns number of page frames stored in @param frames
+ */
+uint64_t __paging_unmap_frames(pml_table_t* pml4_table, vaddr_t vaddr, uint64_t num, paddr_t* frames) {
+    // verify pml4 table is valid
+    if (pml4_table == NULL) {
+        error("[__paging_unmap_frames] pml4 table is null\n");
+        return 0;
+    }
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[__paging_unmap_frames] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    return paging_unmap_range(pml4_table, vaddr, num, frames);
+}
+
+/*
+ * __paging_translate
+ * finds the page frame @param vaddr is mapped to
+ * @param pml4_table: the physical address of pml4 table to look up addresses in
+ * @param vaddr: virtual address to look up
+ * @returns physical address of the page frame or 0 if @param vaddr is not mapped
+ */
+paddr_t __paging_translate(pml_table_t* pml4_table, vaddr_t vaddr) {
+    uint8_t level;
+    pml_entry_t* pentry = paging_lookup(pml4_table, vaddr, &level);
+    if (pentry == NULL || !paging_check_flags(pentry, PAGE_PRESENT))
+        return 0;
+
+    // page frame inside a large page, bit 12 of large page entries is the pat bit
+    uint64_t size = paging_level_pages(level) * PAGE_SIZE;
+    return (paging_get_paddr(pentry) & ~(size - 1)) + (ALIGN_DOWN(vaddr, PAGE_SIZE) & (size - 1));
 }
 
 /*
@@ -342,37 +731,210 @@ void paging_map(vaddr_t vaddr, paddr_t paddr, uint64_t flags) {
  * @parama flags: flags to make mapping with
  */
 void paging_maps(vaddr_t vaddr, paddr_t paddr, uint64_t num, uint64_t flags) {
-    for (uint64_t i = 0; i < num; i++) {
-        paging_map(vaddr, paddr, flags);
-        vaddr += PAGE_SIZE;
-        paddr += PAGE_SIZE;
-    }
+    pml_table_t* pml4_table = paging_cr3();
+    __paging_maps(pml4_table, vaddr, paddr, num, flags);
+}
+
+/*
+ * paging_map_frames
+ * maps @param num pages from @param vaddr to the page frames in @param frames with pml4 table currently in cr3
+ * @param vaddr: virtual address to map
+ * @param frames: page frame for each page
+ * @param num: num pages to map
+ * @param flags: flags to make mappings with
+ */
+void paging_map_frames(vaddr_t vaddr, const paddr_t* frames, uint64_t num, uint64_t flags) {
+    pml_table_t* pml4_table = paging_cr3();
+    __paging_map_frames(pml4_table, vaddr, frames, num, flags);
 }
 
 /*
  * paging_unmap
  * unmaps page from @param vaddr with pml4 table currently in cr3
+ * NOTE: other processors may use the page until @param batch is flushed and waited for, see mm/tlb.h
  * @param vaddr: virtual address to unmap
+ * @param batch: collects the invalidation, for the address space @param vaddr belongs to
  */
-void paging_unmap(vaddr_t vaddr) {
+void paging_unmap(vaddr_t vaddr, tlb_batch_t* batch) {
     pml_table_t* pml4_table = paging_cr3();
-    __paging_unmap(pml4_table, vaddr);
-
-    // invalidate page in tlb 
-    invlpg(vaddr);
+    if (__paging_unmap(pml4_table, vaddr))
+        tlb_batch_add(batch, vaddr, 1);
 }
 
 /*
  * paging_unmaps
  * unmaps @param num page from @param vaddr with pml4 table currently in cr3
+ * the page tables are walked once and the range is invalidated as a whole, with invlpg per page
+ * up to TLB_FLUSH_THRESHOLD pages and by flushing the whole tlb above
+ * NOTE: other processors may use the pages until @param batch is flushed and waited for, see mm/tlb.h
  * @param vaddr: virtual address to unmap
  * @param num: number of pages to numap
+ * @param batch: collects the invalidations, for the address space @param vaddr belongs to
  */
-void paging_unmaps(vaddr_t vaddr, uint64_t num) {
-    for (uint64_t i = 0; i < num; i++) {
-        paging_unmap(vaddr);
-        vaddr += PAGE_SIZE;
+void paging_unmaps(vaddr_t vaddr, uint64_t num, tlb_batch_t* batch) {
+    pml_table_t* pml4_table = paging_cr3();
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[paging_unmaps] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
     }
+
+    if (paging_unmap_range(pml4_table, vaddr, num, NULL))
+        tlb_batch_add(batch, vaddr, num);
+}
+
+/*
+ * paging_unmap_frames
+ * unmaps @param num pages from @param vaddr with pml4 table currently in cr3 and collects their page frames
+ * NOTE: the page frames may only be reused once @param batch is flushed and waited for, see mm/tlb.h
+ * @param vaddr: virtual address to unmap
+ * @param num: number of pages to unmap
+ * @param frames: filled with the page frames of the pages that were mapped, room for @param num frames
+ * @param batch: collects the invalidations, for the address space @param vaddr belongs to
+ * @returns number of page frames stored in @param frames
+ */
+uint64_t paging_unmap_frames(vaddr_t vaddr, uint64_t num, paddr_t* frames, tlb_batch_t* batch) {
+    pml_table_t* pml4_table = paging_cr3();
+
+    // verify vaddr is 4KiB aligned
+    if (vaddr % PAGE_SIZE) {
+        warning("[paging_unmap_frames] vaddr is not 4 KiB aligned, vaddr: %lx\n", vaddr); 
+        vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    }
+
+    uint64_t num_unmapped = paging_unmap_range(pml4_table, vaddr, num, frames);
+    if (num_unmapped)
+        tlb_batch_add(batch, vaddr, num);
+
+    return num_unmapped;
+}
+
+/*
+ * paging_translate
+ * finds the page frame @param vaddr is mapped to with pml4 table currently in cr3
+ * @param vaddr: virtual address to look up
+ * @returns physical address of the page frame or 0 if @param vaddr is not mapped
+ */
+paddr_t paging_translate(vaddr_t vaddr) {
+    pml_table_t* pml4_table = paging_cr3();
+    return __paging_translate(pml4_table, vaddr);
+}
+
+/*
+ * paging_space_create
+ * creates an address space with the mappings of kernel_space and a pcid of its own if one is left
+ * NOTE: the pml4 entries of kernel_space are copied, the identity map included as page tables are
+ * accessed through it. paging_init creates every higher half pml4 entry, later kernel mappings show up
+ * in all address spaces
+ * @param space : address space to create
+ */
+void paging_space_create(addrspace_t* space) {
+    space->pml4_table = paging_create();
+    space->pcid = PAGING_KERNEL_PCID;
+    space->tlb_cpus = 0;
+    space->active_cpus = 0;
+
+    for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++)
+        space->pml4_table->entries[i] = kernel_space.pml4_table->entries[i];
+
+    if (!pcids_enabled)
+        return;
+
+    // a pcid that was used before is flushed on the first switch of every processor, tlb_cpus starts empty
+    uint64_t rflags = spin_lock_irqsave(&pcid_lock);
+    size_t pcid = bitmap_find_range(&pcids, 0, 0, 1);
+    if (pcid != (size_t) -1) {
+        bitmap_set(&pcids, pcid);
+        space->pcid = pcid;
+    }
+    spin_unlock_irqrestore(&pcid_lock, rflags);
+
+    if (space->pcid == PAGING_KERNEL_PCID)
+        warning("[paging_space_create] out of pcids, address space 0x%lx is flushed on every switch\n", space->pml4_table);
+}
+
+/*
+ * paging_destroy_tables
+ * destroys @param ptable and the tables below it, mapped page frames are not freed
+ * @param ptable : the physical address of pml table to destroy
+ * @param level : level of @param ptable
+ */
+static void paging_destroy_tables(pml_table_t* ptable, uint8_t level) {
+    for (size_t i = 0; level > PML1 && i < PAGE_TABLE_ENTRIES; i++) {
+        pml_entry_t* pentry = &ptable->entries[i];
+        if (paging_check_flags(pentry, PAGE_PRESENT) && !paging_check_flags(pentry, PAGE_PSIZE))
+            paging_destroy_tables((pml_table_t*) paging_get_paddr(pentry), level - 1);
+    }
+
+    paging_destroy(ptable);
+}
+
+/*
+ * paging_space_destroy
+ * destroys the page tables of @param space that are not shared with kernel_space and gives back its pcid
+ * @param space : address space to destroy, must not be loaded on any processor
+ */
+void paging_space_destroy(addrspace_t* space) {
+    // paging structure caches of processors running the address space may still point into its tables
+    if (__atomic_load_n(&space->active_cpus, __ATOMIC_SEQ_CST)) {
+        error("[paging_space_destroy] address space 0x%lx is loaded\n", space->pml4_table);
+        return;
+    }
+
+    for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+        pml_entry_t* pentry = &space->pml4_table->entries[i];
+        if (paging_check_flags(pentry, PAGE_PRESENT) && *pentry != kernel_space.pml4_table->entries[i])
+            paging_destroy_tables((pml_table_t*) paging_get_paddr(pentry), PML3);
+    }
+
+    paging_destroy(space->pml4_table);
+    space->pml4_table = NULL;
+
+    if (space->pcid != PAGING_KERNEL_PCID) {
+        uint64_t rflags = spin_lock_irqsave(&pcid_lock);
+        bitmap_clear(&pcids, space->pcid);
+        spin_unlock_irqrestore(&pcid_lock, rflags);
+    }
+}
+
+/*
+ * paging_switch
+ * loads @param space on the current processor
+ * tlb entries tagged with the pcid of @param space are kept if this processor has not dropped them
+ * since it last ran @param space, global kernel entries are always kept
+ * @param space : address space to load
+ */
+void paging_switch(addrspace_t* space) {
+    uint64_t cr3 = (uint64_t) space->pml4_table;
+    uint64_t cpu = (uint64_t) 1 << smp_cpu_id();
+    addrspace_t* prev = paging_current_space();
+
+    // shootdowns for the address space reach this processor before it decides to keep its tlb entries
+    __atomic_fetch_or(&space->active_cpus, cpu, __ATOMIC_SEQ_CST);
+
+    if (pcids_enabled) {
+        cr3 |= space->pcid;
+
+        // PAGING_KERNEL_PCID is shared by address spaces without a pcid of their own
+        if (space->pcid != PAGING_KERNEL_PCID && (__atomic_fetch_or(&space->tlb_cpus, cpu, __ATOMIC_SEQ_CST) & cpu))
+            cr3 |= CR3_NOFLUSH;
+    }
+
+    load_cr3(cr3);
+    current_spaces[smp_cpu_id()] = space;
+
+    if (prev != space)
+        __atomic_fetch_and(&prev->active_cpus, ~cpu, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * paging_current_space
+ * @returns address space loaded on the current processor
+ */
+addrspace_t* paging_current_space(void) {
+    addrspace_t* space = current_spaces[smp_cpu_id()];
+    return (space != NULL) ? space : &kernel_space;
 }
 
 /*
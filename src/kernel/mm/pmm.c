@@ -1,192 +1,1169 @@
 #include <mem/mem.h>
+#include <mem/arena.h>
 #include <mm/pmm.h>
+#include <mm/paging.h>
+#include <cpu/smp.h>
+#include <acpi/srat.h>
+#include <acpi/slit.h>
 
-/* static area for allocating buddy system structures */
-static uint8_t alloc_area[1 * MiB];
-static uint8_t* alloc_ptr = alloc_area;
+/* 
+ * boot area holding the page frame descriptor array and the zone bitmaps 
+ * NOTE: carved out of usable memory by pmm_init_area, sized for the memory present
+ */
+static paddr_t area_start = 0;
+static paddr_t area_end = 0;
+static arena_t area_arena;
 
 static inline uint8_t* alloc(size_t size, size_t align) {
-    uint8_t* ret = (uint8_t*) ALIGN_UP((uint64_t) alloc_ptr, align);
+    uint8_t* ret = (uint8_t*) arena_alloc(&area_arena, size, align);
+    if (ret == NULL)
+        panic("[alloc] pmm ran out of space for buddy system structures, requested 0x%lx bytes.", size);
+
     memset(ret, 0, size);
-    alloc_ptr = ret + size;
     return ret;
 }
 
 /* memory bookkeeping */
 static size_t mem_size = 0;
 
-/* zone information */
-/* NOTE: offsets must be 4KiB aligned */
-static zone_t mem_zone[PMM_NUM_ZONES] = {
-    // DMA: 0 MiB - 16 MiB
-    [PMM_ZONE_DMA] = {
-        .mem_total = (size_t) -1,
-        .mem_free = (size_t) -1,
-        .mem_used = (size_t) -1,
-        .offset = 0,
-        .bitmap = { .size = (size_t) -1, .data = NULL },
-        .first_free_idx = (size_t) -1,
-        .zone = PMM_ZONE_DMA
-    },
-
-    // NORMAL: 16 MiB - end of memory
-    [PMM_ZONE_NORMAL] = {
-        .mem_total = (size_t) -1,
-        .mem_free = (size_t) -1,
-        .mem_used = (size_t) -1,
-        .offset = (16 * MiB),
-        .bitmap = { .size = (size_t) -1, .data = NULL },
-        .first_free_idx = (size_t) -1,
-        .zone = PMM_ZONE_NORMAL
-    }
+/* 
+ * memory above deferred_start is initialized in steps after boot by pmm_init_deferred, the descriptors of
+ * its chunk are initialized (up to deferred_desc) before any of it is registered so freed blocks never
+ * coalesce with buddies whose descriptors are not initialized yet
+ * NOTE: both only ever grow, mem_size once all memory is initialized
+ */
+static paddr_t deferred_start = 0;
+static paddr_t deferred_desc = 0;
+static volatile uint32_t deferred_owner = 0;    /* logical id + 1 of the processor taking steps, 0 if none */
+static struct stivale2_struct_tag_memmap* boot_memmap = NULL;
+
+/* 
+ * per-cpu page frame caches 
+ * NOTE: cached frames are accounted as used by their zone
+ */
+static pcp_t pcp_caches[SMP_MAX_CPUS][PMM_NUM_ZONES];
+
+/* 
+ * number of page colours (power of 2), frames whose pfn differ by a multiple of it map to the same cache sets 
+ * NOTE: 1 disables colouring
+ */
+static size_t num_colours = 1;
+#define frame_colour(addr)  (((addr) / PAGE_SIZE) & (num_colours - 1))
+
+/* pre-zeroed frames of every node, filled from the idle loop */
+static zero_pool_t zero_pools[SRAT_MAX_NODES];
+
+/* 
+ * zone information, one set of zones per numa node
+ * NOTE: offsets must be 4KiB aligned 
+ */
+static zone_t mem_zone[SRAT_MAX_NODES][PMM_NUM_ZONES];
+static uint32_t num_nodes = 1;
+
+/* physical range every zone type is restricted to, NORMAL ends at the end of memory */
+static const paddr_t zone_type_start[PMM_NUM_ZONES] = {
+    [PMM_ZONE_DMA] = 0,                 // DMA: 0 MiB - 16 MiB
+    [PMM_ZONE_NORMAL] = (16 * MiB)      // NORMAL: 16 MiB - end of memory
 };
 
+/* 
+ * page frame descriptors of [0, mem_size), indexed by page frame number 
+ * NOTE: carved out of the first usable memory region large enough and accessed through the HHDM
+ */
+page_t* pmm_pages = NULL;
+static size_t num_pages = 0;
+
+/* nodes to allocate from in order of SLIT distance, the node itself comes first */
+static uint32_t node_fallback[SRAT_MAX_NODES][SRAT_MAX_NODES];
+
+/* buddy system utility macros */
+#define zone_pfn(z)         ((z)->offset / PAGE_SIZE)                           // first page frame number of zone
+#define zone_end_pfn(z)     (zone_pfn(z) + (z)->bitmap.size)                    // exclusive
+#define order_pages(order)  (((size_t) 1) << (order))
+#define block_ptr(pfn)      ((pmm_block_t*) P2V((pfn) * PAGE_SIZE))
+#define block_pfn(block)    (V2P((vaddr_t) (block)) / PAGE_SIZE)
+#define page_zone(page)     (&mem_zone[(page)->zone_idx / PMM_NUM_ZONES][(page)->zone_idx % PMM_NUM_ZONES])
+
 /* print zone mem stats */
 static inline void print_mem_stats(void) {
     log("\n");
-    for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
-        log("zone: %lu\n", mem_zone[zone].zone);
-        log("mem_total: %lx\n", mem_zone[zone].mem_total);
-        log("mem_free: %lx\n", mem_zone[zone].mem_free);
-        log("mem_used: %lx\n", mem_zone[zone].mem_used);
-        log("offset: %lx\n", mem_zone[zone].offset);
-        log("first_free_idx: %lx\n", mem_zone[zone].first_free_idx);
-        log("\n");
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
+            zone_t* z = &mem_zone[node][zone];
+            log("node: %u\n", z->node);
+            log("zone: %lu\n", z->zone);
+            log("mem_total: %lx\n", z->mem_total);
+            log("mem_free: %lx\n", z->mem_free);
+            log("mem_used: %lx\n", z->mem_used);
+            log("offset: %lx\n", z->offset);
+            log("first_free_idx: %lx\n", z->first_free_idx);
+            for (uint8_t order = 0; order <= PMM_MAX_ORDER; order++)
+                log("free blocks of order %u: %lu\n", order, z->free_area[order].num_free);
+            log("\n");
+        }
+    }
+}
+
+/*
+ * pmm_order
+ * @param size : num pages
+ * @returns smallest order whose blocks can hold @param size pages
+ */
+static inline uint8_t pmm_order(size_t size) {
+    if (size <= 1)
+        return 0;
+
+    return (uint8_t) (64 - __builtin_clzl(size - 1));
+}
+
+/*
+ * buddy_in_zone
+ * @returns true if the whole block starting at @param pfn of @param order lies within @param z
+ */
+static inline bool buddy_in_zone(zone_t* z, size_t pfn, uint8_t order) {
+    return pfn >= zone_pfn(z) && pfn + order_pages(order) <= zone_end_pfn(z);
+}
+
+/*
+ * buddy_is_free
+ * @returns true if the block starting at @param pfn is a free block of exactly @param order
+ */
+static inline bool buddy_is_free(zone_t* z, size_t pfn, uint8_t order) {
+    if (!buddy_in_zone(z, pfn, order))
+        return false;
+
+    page_t* page = pfn_to_page(pfn);
+    return (page->flags & PG_BUDDY) && page->order == order;
+}
+
+/*
+ * freelist_insert
+ * inserts a free block into the free area of its order
+ * @param z : zone to insert block in
+ * @param pfn : page frame number of the first page in the block
+ * @param order : order of the block
+ * @param tail : insert at the tail of the freelist instead of the head
+ */
+static void freelist_insert(zone_t* z, size_t pfn, uint8_t order, bool tail) {
+    free_area_t* area = &z->free_area[order];
+    pmm_block_t* block = block_ptr(pfn);
+
+    if (area->head == NULL) {
+        block->next = block;
+        block->prev = block;
+        area->head = block;
+    } else {
+        block->next = area->head;
+        block->prev = area->head->prev;
+        area->head->prev->next = block;
+        area->head->prev = block;
+
+        if (!tail)
+            area->head = block;
+    }
+
+    pfn_to_page(pfn)->flags |= PG_BUDDY;
+    pfn_to_page(pfn)->order = order;
+    area->num_free++;
+}
+
+/*
+ * freelist_remove
+ * removes a free block from the free area of its order
+ * @param z : zone to remove block from
+ * @param pfn : page frame number of the first page in the block
+ * @param order : order of the block
+ */
+static void freelist_remove(zone_t* z, size_t pfn, uint8_t order) {
+    free_area_t* area = &z->free_area[order];
+    pmm_block_t* block = block_ptr(pfn);
+
+    if (block->next == block) {
+        area->head = NULL;
+    } else {
+        block->prev->next = block->next;
+        block->next->prev = block->prev;
+
+        if (area->head == block)
+            area->head = block->next;
+    }
+
+    pfn_to_page(pfn)->flags &= ~PG_BUDDY;
+    area->num_free--;
+}
+
+/*
+ * buddy_free
+ * returns a block to the buddy system, coalescing it with its free buddies
+ * @param z : zone the block belongs to
+ * @param pfn : page frame number of the first page in the block
+ * @param order : order of the block
+ * @param tail : insert coalesced block at the tail of its freelist
+ */
+static void buddy_free(zone_t* z, size_t pfn, uint8_t order, bool tail) {
+    while (order < PMM_MAX_ORDER) {
+        size_t buddy = pfn ^ order_pages(order);
+        if (!buddy_is_free(z, buddy, order))
+            break;
+
+        freelist_remove(z, buddy, order);
+        pfn &= ~order_pages(order);
+        order++;
+    }
+
+    freelist_insert(z, pfn, order, tail);
+}
+
+/*
+ * buddy_alloc
+ * removes a block of @param order from the buddy system, splitting larger blocks if necessary
+ * @param z : zone to allocate from
+ * @param order : order of the block
+ * @returns page frame number of the block or (size_t) -1 if no block was found
+ */
+static size_t buddy_alloc(zone_t* z, uint8_t order) {
+    uint8_t curr = order;
+    while (curr <= PMM_MAX_ORDER && z->free_area[curr].num_free == 0)
+        curr++;
+
+    if (curr > PMM_MAX_ORDER)
+        return (size_t) -1;
+
+    size_t pfn = block_pfn(z->free_area[curr].head);
+    freelist_remove(z, pfn, curr);
+
+    // split block, upper halves go back to the buddy system
+    while (curr > order) {
+        curr--;
+        freelist_insert(z, pfn + order_pages(curr), curr, false);
+    }
+
+    return pfn;
+}
+
+/*
+ * buddy_free_range
+ * returns an arbitrary range of pages to the buddy system as the largest possible aligned blocks
+ * @param z : zone the range belongs to
+ * @param pfn : first page frame number of range
+ * @param num : num pages in range
+ * @param tail : insert blocks at the tail of their freelists
+ */
+static void buddy_free_range(zone_t* z, size_t pfn, size_t num, bool tail) {
+    while (num) {
+        uint8_t align_order = pfn ? __builtin_ctzl(pfn) : PMM_MAX_ORDER;
+        uint8_t size_order = 63 - __builtin_clzl(num);
+        uint8_t order = MIN(align_order, size_order);
+        order = MIN(order, PMM_MAX_ORDER);
+
+        buddy_free(z, pfn, order, tail);
+        pfn += order_pages(order);
+        num -= order_pages(order);
+    }
+}
+
+/*
+ * buddy_claim_range
+ * removes an arbitrary range of free pages from the buddy system
+ * @param z : zone the range belongs to
+ * @param pfn : first page frame number of range
+ * @param num : num pages in range
+ */
+static void buddy_claim_range(zone_t* z, size_t pfn, size_t num) {
+    size_t end = pfn + num;
+    size_t curr = pfn;
+
+    while (curr < end) {
+        // find free block containing curr
+        uint8_t order = 0;
+        size_t head = curr;
+        for ( ; order <= PMM_MAX_ORDER; order++) {
+            head = ALIGN_DOWN(curr, order_pages(order));
+            if (buddy_is_free(z, head, order))
+                break;
+        }
+
+        if (order > PMM_MAX_ORDER)
+            panic("[buddy_claim_range] page frame 0x%lx is not free in the buddy system.", curr);
+
+        // remove block and give back the parts outside of the range
+        size_t block_end = head + order_pages(order);
+        freelist_remove(z, head, order);
+        if (head < pfn)
+            buddy_free_range(z, head, pfn - head, false);
+        if (block_end > end)
+            buddy_free_range(z, end, block_end - end, false);
+
+        curr = block_end;
+    }
+}
+
+/*
+ * zone_mark_used
+ * marks @param size pages starting at @param pfn as used after they were taken from the buddy system
+ * NOTE: zone lock must be held
+ */
+static void zone_mark_used(zone_t* z, size_t pfn, size_t size) {
+    size_t idx = pfn - zone_pfn(z);
+    bitmap_set_range(&z->bitmap, idx, size);
+
+    // update zone bookkeeping
+    z->mem_free -= size * PAGE_SIZE;
+    z->mem_used += size * PAGE_SIZE;
+    if (z->first_free_idx >= idx && z->first_free_idx < idx + size)
+        z->first_free_idx = idx + size;
+}
+
+/* 
+ * zone_alloc
+ * allocates @param size pages from the buddy system of @param z
+ * NOTE: zone lock must be held
+ * @param align : alignment of the first page frame number, power of 2
+ * @returns physical address of first page or 0 if no free pages were found
+ */
+static paddr_t zone_alloc(zone_t* z, size_t size, size_t align) {
+    size_t pfn;
+    uint8_t order = pmm_order(size);
+    uint8_t align_order = __builtin_ctzl(align);
+    order = MAX(order, align_order);
+
+    if (order <= PMM_MAX_ORDER) {
+        // buddy blocks are naturally aligned to their size
+        pfn = buddy_alloc(z, order);
+        if (pfn == (size_t) -1)
+            return 0;
+
+        // give back unused tail of block
+        if (order_pages(order) > size)
+            buddy_free_range(z, pfn + size, order_pages(order) - size, false);
+
+    } else {
+        // larger than any buddy block, search the zone bitmap for a free run (the summary skips used stretches)
+        size_t idx = z->first_free_idx;
+        while (true) {
+            idx = bitmap_find_range(&z->bitmap, idx, PMM_FREE, size);
+            if (idx == (size_t) -1)
+                return 0;
+
+            // retry from the next aligned frame if the run is misaligned
+            size_t aligned = ALIGN_UP(zone_pfn(z) + idx, align) - zone_pfn(z);
+            if (aligned == idx)
+                break;
+            idx = aligned;
+        }
+
+        pfn = zone_pfn(z) + idx;
+        buddy_claim_range(z, pfn, size);
+    }
+
+    zone_mark_used(z, pfn, size);
+    return pfn * PAGE_SIZE;
+}
+
+/*
+ * zone_alloc_bulk
+ * allocates up to @param num single frames from @param z, taking the largest buddy blocks available
+ * NOTE: zone lock must be held
+ * @param frames : filled with the physical address of every frame
+ * @returns number of frames allocated
+ */
+static size_t zone_alloc_bulk(zone_t* z, size_t num, paddr_t* frames) {
+    size_t count = 0;
+    uint8_t order = PMM_MAX_ORDER;
+
+    while (count < num) {
+        // largest block that is not more than what is left
+        uint8_t max_order = 63 - __builtin_clzl(num - count);
+        order = MIN(order, max_order);
+
+        size_t pfn = buddy_alloc(z, order);
+        if (pfn == (size_t) -1) {
+            // only smaller blocks are left
+            if (order == 0)
+                break;
+            order--;
+            continue;
+        }
+
+        zone_mark_used(z, pfn, order_pages(order));
+        for (size_t i = 0; i < order_pages(order); i++)
+            frames[count++] = (pfn + i) * PAGE_SIZE;
+    }
+
+    return count;
+}
+
+/* 
+ * zone_free
+ * returns @param size pages starting at @param addr to the buddy system of @param z
+ * NOTE: zone lock must be held
+ */
+static void zone_free(zone_t* z, paddr_t addr, size_t size) {
+    // verify pages are in use
+    size_t idx = (addr - z->offset) / PAGE_SIZE;
+    if (idx + size > z->bitmap.size || bitmap_get(&z->bitmap, idx) == PMM_FREE) {
+        error("[pmm_free] free request on unused or out of zone pages, addr: 0x%lx, size: %lu\n", addr, size);
+        return;
+    }
+
+    // free the pages
+    bitmap_clear_range(&z->bitmap, idx, size);
+    buddy_free_range(z, zone_pfn(z) + idx, size, false);
+    
+    // update zone bookkeeping
+    z->mem_free += size * PAGE_SIZE;
+    z->mem_used -= size * PAGE_SIZE;
+    if (idx < z->first_free_idx)
+        z->first_free_idx = idx;
+}
+
+/*
+ * pcp_refill
+ * moves a batch of single frames from @param z into @param pcp
+ * NOTE: interrupts must be disabled
+ */
+static void pcp_refill(zone_t* z, pcp_t* pcp) {
+    spin_lock(&z->lock);
+    while (pcp->count < PMM_PCP_BATCH) {
+        paddr_t addr = zone_alloc(z, 1, 1);
+        if (addr == 0)
+            break;
+
+        pcp->frames[pcp->count++] = addr;
+    }
+    spin_unlock(&z->lock);
+}
+
+/*
+ * pcp_take
+ * takes the hottest frame of the next colour out of @param pcp, or the hottest frame if no frame has that colour
+ * NOTE: interrupts must be disabled, @param pcp must not be empty
+ */
+static paddr_t pcp_take(pcp_t* pcp) {
+    size_t idx = pcp->count - 1;
+
+    if (num_colours > 1) {
+        for (size_t i = pcp->count; i-- > 0; ) {
+            if (frame_colour(pcp->frames[i]) == pcp->next_colour) {
+                idx = i;
+                break;
+            }
+        }
+
+        pcp->next_colour = (frame_colour(pcp->frames[idx]) + 1) & (num_colours - 1);
     }
+
+    // keep the remaining frames ordered from cold to hot
+    paddr_t addr = pcp->frames[idx];
+    for (size_t i = idx + 1; i < pcp->count; i++)
+        pcp->frames[i - 1] = pcp->frames[i];
+    pcp->count--;
+
+    return addr;
+}
+
+/*
+ * pcp_drain
+ * returns the @param num coldest frames of @param pcp to @param z
+ * NOTE: interrupts must be disabled
+ */
+static void pcp_drain(zone_t* z, pcp_t* pcp, size_t num) {
+    num = MIN(num, pcp->count);
+
+    spin_lock(&z->lock);
+    for (size_t i = 0; i < num; i++)
+        zone_free(z, pcp->frames[i], 1);
+    spin_unlock(&z->lock);
+
+    for (size_t i = num; i < pcp->count; i++)
+        pcp->frames[i - num] = pcp->frames[i];
+    pcp->count -= num;
+}
+
+/*
+ * pmm_local_node
+ * @returns numa node of the current processor, node 0 if SRAT did not describe memory of its node
+ */
+static inline uint32_t pmm_local_node(void) {
+    uint32_t node = smp_cpu_node();
+    return (node < num_nodes) ? node : 0;
+}
+
+/*
+ * zone_alloc_pages
+ * allocates @param size pages from @param z, single frames of the local node are served from the per-cpu cache
+ * @param align : alignment of the first page frame number, power of 2
+ * @returns physical address of first page or 0 if @param z has no free run of @param size pages
+ */
+static paddr_t zone_alloc_pages(zone_t* z, size_t size, size_t align) {
+    paddr_t addr = 0;
+
+    if (size == 1 && align == 1 && z->node == pmm_local_node()) {
+        uint64_t rflags;
+        dump_rflags(rflags);
+        cli();
+
+        pcp_t* pcp = &pcp_caches[smp_cpu_id()][z->zone];
+        if (pcp->count == 0)
+            pcp_refill(z, pcp);
+        if (pcp->count)
+            addr = pcp_take(pcp);
+
+        load_rflags(rflags);
+    } else {
+        uint64_t rflags = spin_lock_irqsave(&z->lock);
+        addr = zone_alloc(z, size, align);
+        spin_unlock_irqrestore(&z->lock, rflags);
+    }
+
+    return addr;
+}
+
+/*
+ * node_alloc
+ * allocates @param size pages aligned to @param align pages on @param node
+ * falls back to the other nodes in order of SLIT distance if @param node has no free pages
+ */
+static paddr_t node_alloc(uint32_t node, zone_e zone, size_t size, size_t align) {
+    paddr_t addr = 0;
+
+    if (size == 0)
+        panic("[pmm_alloc] request for 0 pages.");
+
+    if (node >= num_nodes)
+        panic("[pmm_alloc] request for pages on invalid node %u.", node);
+
+    if (align == 0 || (align & (align - 1)))
+        panic("[pmm_alloc] alignment of %lu pages is not a power of 2.", align);
+
+    // initialize deferred memory until the request fits
+    do {
+        for (uint32_t i = 0; i < num_nodes && addr == 0; i++)
+            addr = zone_alloc_pages(&mem_zone[node_fallback[node][i]][zone], size, align);
+    } while (addr == 0 && pmm_init_deferred(1));
+
+    if (addr == 0)
+        panic("pmm_alloc could not find %lu of free pages.", size);
+
+    page_t* page = addr_to_page(addr);
+    for (size_t i = 0; i < size; i++)
+        page[i].refcount = 1;
+
+    return addr;
+}
+
+/* 
+ * allocate physical page frames on @param node
+ * @param node : numa node to allocate in
+ * @param zone : zone to allocate in 
+ * @param size : num pages to allocate 
+ */
+paddr_t pmm_alloc_node(uint32_t node, zone_e zone, size_t size) {
+    return node_alloc(node, zone, size, 1);
+}
+
+/* 
+ * allocate naturally aligned physical page frames on the node of the current processor
+ * i.e. PMM_ALIGN_2M and PMM_ALIGN_1G back huge page mappings
+ * @param zone : zone to allocate in 
+ * @param size : num pages to allocate 
+ * @param align : alignment in pages, power of 2
+ */
+paddr_t pmm_alloc_aligned(zone_e zone, size_t size, size_t align) {
+    return node_alloc(pmm_local_node(), zone, size, align);
 }
 
 /* 
- * allocate physical page frames 
+ * allocate physical page frames on the node of the current processor
+ * single frames are served from the per-cpu cache without touching the zone
  * @param zone : zone to allocate in 
  * @param size : num pages to allocate 
  */
 paddr_t pmm_alloc(zone_e zone, size_t size) {
-    size_t idx = bitmap_find_range(&mem_zone[zone].bitmap, mem_zone[zone].first_free_idx, PMM_FREE, size);
+    return node_alloc(pmm_local_node(), zone, size, 1);
+}
 
-    if (idx == (size_t) -1)
-        panic("pmm_alloc could not find %lu of free pages.", size);
-    
-    bitmap_set_range(&mem_zone[zone].bitmap, idx, size);
+/*
+ * free_zone
+ * verifies @param size pages at @param addr can be freed and releases their descriptors
+ * @returns zone of the pages or NULL if they are not in use
+ */
+static zone_t* free_zone(paddr_t addr, size_t size) {
+    // find zone through the page frame descriptor, descriptors of deferred memory are not initialized yet
+    if (addr >= __atomic_load_n(&deferred_start, __ATOMIC_ACQUIRE))
+        panic("pmm_free could not identify the zone for addr %lx.\n", addr);
 
-    // update zone bookkeeping
-    mem_zone[zone].mem_free -= size * PAGE_SIZE;
-    mem_zone[zone].mem_used += size * PAGE_SIZE;
-    mem_zone[zone].first_free_idx = idx + size;
+    page_t* page = addr_to_page(addr);
+    zone_t* z = page_zone(page);
 
-    return mem_zone[zone].offset + (PAGE_SIZE * idx);
+    // frames must be in use (cached frames are still marked as used in the zone)
+    size_t idx = (addr - z->offset) / PAGE_SIZE;
+    if ((page->flags & PG_RESERVED) || idx + size > z->bitmap.size || bitmap_get(&z->bitmap, idx) == PMM_FREE) {
+        error("[pmm_free] free request on unused or out of zone pages, addr: 0x%lx, size: %lu\n", addr, size);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        page[i].refcount = 0;
+        page[i].owner = NULL;
+    }
+
+    return z;
 }
 
 /* 
  * free physical page frames 
+ * single frames of the local node are put in the per-cpu cache, the coldest frames go back to the zone in batches
  * @param addr : PAGE_SIZE aligned physical addr to free 
  * @param size : num pages to free
  */
 void pmm_free(paddr_t addr, size_t size) {
-    // find zone
-    zone_e zone = 0;
-    for ( ; zone < PMM_NUM_ZONES; zone++) {
-        if (zone + 1 == PMM_NUM_ZONES) {
-            if (addr >= mem_zone[zone].offset && addr < mem_size) 
-                break;
-        } else {
-            if (addr >= mem_zone[zone].offset && addr < mem_zone[zone + 1].offset)
-                break;
+    zone_t* z = free_zone(addr, size);
+    if (z == NULL)
+        return;
+
+    if (size == 1 && z->node == pmm_local_node()) {
+        uint64_t rflags;
+        dump_rflags(rflags);
+        cli();
+
+        pcp_t* pcp = &pcp_caches[smp_cpu_id()][z->zone];
+        if (pcp->count == PMM_PCP_SIZE)
+            pcp_drain(z, pcp, PMM_PCP_BATCH);
+        pcp->frames[pcp->count++] = addr;
+
+        load_rflags(rflags);
+    } else {
+        uint64_t rflags = spin_lock_irqsave(&z->lock);
+        zone_free(z, addr, size);
+        spin_unlock_irqrestore(&z->lock, rflags);
+    }
+}
+
+/*
+ * allocate @param num single physical page frames that need not be contiguous
+ * frames are taken as whole buddy blocks, one zone lock acquisition per zone instead of one per frame
+ * @param zone : zone to allocate in 
+ * @param num : num frames to allocate
+ * @param frames : filled with the physical address of every frame
+ */
+void pmm_alloc_bulk(zone_e zone, size_t num, paddr_t* frames) {
+    uint32_t node = pmm_local_node();
+    size_t count = 0;
+
+    do {
+        for (uint32_t i = 0; i < num_nodes && count < num; i++) {
+            zone_t* z = &mem_zone[node_fallback[node][i]][zone];
+
+            uint64_t rflags = spin_lock_irqsave(&z->lock);
+            count += zone_alloc_bulk(z, num - count, frames + count);
+            spin_unlock_irqrestore(&z->lock, rflags);
+        }
+    } while (count < num && pmm_init_deferred(1));
+
+    if (count < num)
+        panic("pmm_alloc_bulk could not find %lu of free pages.", num);
+
+    for (size_t i = 0; i < num; i++)
+        addr_to_page(frames[i])->refcount = 1;
+}
+
+/*
+ * free @param num single physical page frames
+ * frames go straight back to their zones, the zone lock is only retaken when the zone changes
+ * @param frames : physical address of every frame
+ * @param num : num frames to free
+ */
+void pmm_free_bulk(paddr_t* frames, size_t num) {
+    zone_t* locked = NULL;
+    uint64_t rflags = 0;
+
+    for (size_t i = 0; i < num; i++) {
+        zone_t* z = free_zone(frames[i], 1);
+        if (z == NULL)
+            continue;
+
+        if (z != locked) {
+            if (locked)
+                spin_unlock_irqrestore(&locked->lock, rflags);
+            rflags = spin_lock_irqsave(&z->lock);
+            locked = z;
         }
+
+        zone_free(z, frames[i], 1);
     }
 
-    // verify a zone was found
-    if (zone == PMM_NUM_ZONES)
-        panic("pmm_free could not identify the zone for addr %lx.\n", addr);
+    if (locked)
+        spin_unlock_irqrestore(&locked->lock, rflags);
+}
 
-    // free the pages
-    size_t idx = (addr - mem_zone[zone].offset) / PAGE_SIZE;
-    bitmap_clear_range(&mem_zone[zone].bitmap, idx, size);
-    
-    // update zone bookkeeping
-    mem_zone[zone].mem_free += size * PAGE_SIZE;
-    mem_zone[zone].mem_used -= size * PAGE_SIZE;
-    if (idx < mem_zone[zone].first_free_idx)
-        mem_zone[zone].first_free_idx = idx;
+/*
+ * zero_frame
+ * clears the page frame at @param addr through the HHDM
+ */
+static inline void zero_frame(paddr_t addr) {
+    void* dest = (void*) P2V(addr);
+    size_t count = PAGE_SIZE / sizeof(uint64_t);
+
+    asm volatile("rep stosq" : "+D" (dest), "+c" (count) : "a" ((uint64_t) 0) : "memory");
+}
+
+/*
+ * allocate zero filled physical page frames
+ * single NORMAL frames are taken from the pre-zeroed pool of the local node, anything else is cleared here
+ * @param zone : zone to allocate in 
+ * @param size : num pages to allocate 
+ */
+paddr_t pmm_alloc_zeroed(zone_e zone, size_t size) {
+    paddr_t addr = 0;
+
+    if (size == 1 && zone == PMM_ZONE_NORMAL) {
+        zero_pool_t* pool = &zero_pools[pmm_local_node()];
+
+        uint64_t rflags = spin_lock_irqsave(&pool->lock);
+        if (pool->count)
+            addr = pool->frames[--pool->count];
+        spin_unlock_irqrestore(&pool->lock, rflags);
+
+        if (addr) {
+            addr_to_page(addr)->refcount = 1;
+            return addr;
+        }
+    }
+
+    // pool is empty, clear synchronously
+    addr = pmm_alloc(zone, size);
+    for (size_t i = 0; i < size; i++)
+        zero_frame(addr + i * PAGE_SIZE);
+
+    return addr;
+}
+
+/*
+ * pmm_zero_idle
+ * tops up the pre-zeroed pool of the local node with at most PMM_ZERO_BATCH frames
+ * NOTE: meant for idle loops, frames are cleared without holding any lock
+ */
+void pmm_zero_idle(void) {
+    uint32_t node = pmm_local_node();
+    zero_pool_t* pool = &zero_pools[node];
+    zone_t* z = &mem_zone[node][PMM_ZONE_NORMAL];
+
+    if (__atomic_load_n(&pool->count, __ATOMIC_RELAXED) >= PMM_ZERO_POOL_SIZE)
+        return;
+
+    // take cold frames straight from the zone, the per-cpu cache keeps its hot ones
+    paddr_t frames[PMM_ZERO_BATCH];
+    size_t num = 0;
+    uint64_t rflags = spin_lock_irqsave(&z->lock);
+    for ( ; num < PMM_ZERO_BATCH; num++) {
+        frames[num] = zone_alloc(z, 1, 1);
+        if (frames[num] == 0)
+            break;
+    }
+    spin_unlock_irqrestore(&z->lock, rflags);
+
+    for (size_t i = 0; i < num; i++)
+        zero_frame(frames[i]);
+
+    // another processor of the node may have filled the pool meanwhile
+    size_t i = 0;
+    rflags = spin_lock_irqsave(&pool->lock);
+    for ( ; i < num && pool->count < PMM_ZERO_POOL_SIZE; i++)
+        pool->frames[pool->count++] = frames[i];
+    spin_unlock_irqrestore(&pool->lock, rflags);
+
+    if (i < num) {
+        rflags = spin_lock_irqsave(&z->lock);
+        for ( ; i < num; i++)
+            zone_free(z, frames[i], 1);
+        spin_unlock_irqrestore(&z->lock, rflags);
+    }
+}
+
+/*
+ * pmm_page_get
+ * takes another reference on an allocated page frame (i.e. when it is shared between mappings)
+ * @param addr : physical addr of page frame
+ */
+void pmm_page_get(paddr_t addr) {
+    page_t* page = addr_to_page(addr);
+    if (__atomic_load_n(&page->refcount, __ATOMIC_RELAXED) == 0) {
+        error("[pmm_page_get] reference taken on free page, addr: 0x%lx\n", addr);
+        return;
+    }
+
+    __atomic_add_fetch(&page->refcount, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * pmm_page_put
+ * drops a reference on a page frame, the frame is freed with the last reference
+ * @param addr : physical addr of page frame
+ */
+void pmm_page_put(paddr_t addr) {
+    page_t* page = addr_to_page(addr);
+    if (__atomic_sub_fetch(&page->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        pmm_free(addr, 1);
 }
 
 /* 
  * set region as unused 
- * @param zone : zone the bitmap is in
+ * @param z : zone the bitmap is in
  * @param bit : bit within bitmap to start clearing
  * @param size : num bits to clearing 
  */
-static inline void pmm_set_unused(zone_e zone, size_t bit, size_t size) {
-    bitmap_clear_range(&mem_zone[zone].bitmap, bit, size);
+static inline void pmm_set_unused(zone_t* z, size_t bit, size_t size) {
+    bitmap_clear_range(&z->bitmap, bit, size);
+    for (size_t i = 0; i < size; i++)
+        pfn_to_page(zone_pfn(z) + bit + i)->flags &= ~PG_RESERVED;
+
+    // regions are registered in ascending order, keep freelists sorted so
+    // early allocations (i.e. paging_init) are served from low memory
+    buddy_free_range(z, zone_pfn(z) + bit, size, true);
+}
+
+/*
+ * pmm_init_nodes
+ * splits [0, mem_size) into one physical range per numa node using the SRAT memory ranges
+ * NOTE: every node is assumed to own a single contiguous range, holes between SRAT ranges go to the node below them
+ * @param node_start : filled with the first address of every node
+ * @param node_end : filled with the end (exclusive) of every node
+ */
+static void pmm_init_nodes(paddr_t* node_start, paddr_t* node_end) {
+    srat_info_t* srat_info = get_srat_info();
+    num_nodes = srat_info->num_nodes;
+
+    // node 0 owns all memory if SRAT does not describe any
+    if (srat_info->num_mem_ranges == 0) {
+        num_nodes = 1;
+        node_start[0] = 0;
+        node_end[0] = mem_size;
+        return;
+    }
+
+    // lowest address of every node, nodes without memory are marked with -1
+    for (uint32_t node = 0; node < num_nodes; node++)
+        node_start[node] = (paddr_t) -1;
+
+    for (uint32_t i = 0; i < srat_info->num_mem_ranges; i++) {
+        srat_mem_range_t* range = &srat_info->mem_ranges[i];
+        paddr_t base = ALIGN_DOWN(range->base, PAGE_SIZE);
+
+        if (base < node_start[range->node])
+            node_start[range->node] = MIN(base, mem_size);
+    }
+
+    // every node ends where the next node above it starts
+    uint32_t lowest_node = 0;
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        if (node_start[node] == (paddr_t) -1) {
+            node_start[node] = node_end[node] = 0;
+            continue;
+        }
+
+        node_end[node] = mem_size;
+        for (uint32_t other = 0; other < num_nodes; other++) {
+            if (node_start[other] != (paddr_t) -1 && node_start[other] > node_start[node] && node_start[other] < node_end[node])
+                node_end[node] = node_start[other];
+        }
+
+        if (node_start[node] < node_start[lowest_node])
+            lowest_node = node;
+    }
+
+    // memory below the lowest SRAT range belongs to the lowest node
+    node_start[lowest_node] = 0;
+}
+
+/*
+ * pmm_init_fallback
+ * orders the nodes every node falls back to by SLIT distance, the node itself always comes first
+ */
+static void pmm_init_fallback(void) {
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        uint32_t* fallback = node_fallback[node];
+
+        fallback[0] = node;
+        size_t count = 1;
+        for (uint32_t other = 0; other < num_nodes; other++) {
+            if (other == node)
+                continue;
+
+            // insertion sort, nodes with equal distance stay in id order
+            size_t i = count++;
+            for ( ; i > 1 && slit_distance(node, fallback[i - 1]) > slit_distance(node, other); i--)
+                fallback[i] = fallback[i - 1];
+            fallback[i] = other;
+        }
+    }
+}
+
+/*
+ * pmm_register_range
+ * sets the usable range [@param start, @param end) as unused in every zone it crosses over
+ * NOTE: the range must be in the HHDM, free blocks get their headers written
+ */
+static void pmm_register_range(paddr_t start, paddr_t end) {
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
+            zone_t* z = &mem_zone[node][zone];
+            paddr_t zone_end = z->offset + z->mem_total;
+            paddr_t zone_start = MAX(start, z->offset);
+            zone_end = MIN(end, zone_end);
+            if (zone_start >= zone_end)
+                continue;
+
+            size_t idx = (zone_start - z->offset) / PAGE_SIZE;
+            size_t size = (zone_end - zone_start) / PAGE_SIZE;
+            uint64_t rflags = spin_lock_irqsave(&z->lock);
+            pmm_set_unused(z, idx, size);
+
+            // update zone bookkeeping
+            z->mem_used -= size * PAGE_SIZE;
+            z->mem_free += size * PAGE_SIZE;
+            if (idx < z->first_free_idx)
+                z->first_free_idx = idx;
+            spin_unlock_irqrestore(&z->lock, rflags);
+        }
+    }
+}
+
+/*
+ * pmm_register_memmap
+ * registers the usable memory of the bootloader memory map that lies within [@param start, @param end)
+ */
+static void pmm_register_memmap(paddr_t start, paddr_t end) {
+    for (uint64_t i = 0; i < boot_memmap->entries; i++) {
+        struct stivale2_mmap_entry entry = boot_memmap->memmap[i];
+        if (entry.type != MEM_USABLE)
+            continue;
+
+        paddr_t entry_start = (paddr_t) ALIGN_UP(entry.base, 4 * KiB);                    // inclusive
+        paddr_t entry_end = (paddr_t) ALIGN_DOWN(entry.base + entry.length, 4 * KiB);     // exclusive
+
+        // page frame 0 is never handed out (it is not in the HHDM and doubles as NULL)
+        entry_start = MAX(entry_start, PAGE_SIZE);
+        entry_start = MAX(entry_start, start);
+        entry_end = MIN(entry_end, end);
+        if (entry_start >= entry_end)
+            continue;
+
+        // the boot area stays reserved
+        if (entry_start < area_start)
+            pmm_register_range(entry_start, MIN(entry_end, area_start));
+        if (entry_end > area_end)
+            pmm_register_range(MAX(entry_start, area_end), entry_end);
+    }
+}
+
+/*
+ * pmm_init_descriptors
+ * resets the page frame descriptors of [@param start, @param end) and links them to their zones
+ * NOTE: every frame is reserved until its usable region is registered
+ */
+static void pmm_init_descriptors(paddr_t start, paddr_t end) {
+    size_t first_pfn = start / PAGE_SIZE;
+    size_t end_pfn = end / PAGE_SIZE;
+
+    memset(pfn_to_page(first_pfn), 0, (end_pfn - first_pfn) * sizeof(page_t));
+    for (size_t pfn = first_pfn; pfn < end_pfn; pfn++)
+        pfn_to_page(pfn)->flags = PG_RESERVED;
+
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
+            zone_t* z = &mem_zone[node][zone];
+            size_t zone_first = MAX(first_pfn, zone_pfn(z));
+            size_t zone_end = MIN(end_pfn, zone_end_pfn(z));
+
+            for (size_t pfn = zone_first; pfn < zone_end; pfn++)
+                pfn_to_page(pfn)->zone_idx = node * PMM_NUM_ZONES + zone;
+        }
+    }
+}
+
+/*
+ * pmm_init_deferred_step
+ * initializes the next PMM_DEFER_STEP bytes of descriptors of the chunk deferred_start is in or, once they
+ * are all initialized, registers its next PMM_DEFER_STEP bytes of memory
+ * NOTE: the caller must own deferred_owner
+ */
+static void pmm_init_deferred_step(void) {
+    paddr_t chunk_end = MIN(ALIGN_DOWN(deferred_start, PMM_DEFER_CHUNK) + PMM_DEFER_CHUNK, mem_size);
+
+    if (deferred_desc < chunk_end) {
+        paddr_t end = MIN(deferred_desc + PMM_DEFER_STEP, chunk_end);
+        pmm_init_descriptors(deferred_desc, end);
+        deferred_desc = end;
+        return;
+    }
+
+    paddr_t end = MIN(deferred_start + PMM_DEFER_STEP, chunk_end);
+    pmm_register_memmap(deferred_start, end);
+    __atomic_store_n(&deferred_start, end, __ATOMIC_RELEASE);
+
+    if (end >= mem_size)
+        log("[pmm_init_deferred] all memory initialized.\n");
+}
+
+/*
+ * pmm_init_deferred
+ * takes @param num steps of initializing the memory pmm_init left out, see pmm_init_deferred_step
+ * called from the idle loop and by allocations that would otherwise fail. interrupts are left as the
+ * caller has them, only zone locks are taken (briefly) with interrupts disabled
+ * NOTE: memory above 4 GiB is only in the HHDM after paging_init, nothing is initialized before.
+ * an interrupt handler cannot take steps while the processor it interrupted is in the middle of one,
+ * and must not wait on locks held by other processors that may wait for such a step
+ * @returns whether any step was taken
+ */
+bool pmm_init_deferred(size_t num) {
+    uint32_t self = smp_cpu_id() + 1;
+    bool initialized = false;
+
+    if (!__atomic_load_n(&paging_ready, __ATOMIC_ACQUIRE))
+        return false;
+
+    for ( ; num; num--) {
+        if (__atomic_load_n(&deferred_start, __ATOMIC_ACQUIRE) >= mem_size)
+            break;
+
+        // one processor takes steps at a time, they are short so others wait for it
+        uint32_t owner = 0;
+        while (!__atomic_compare_exchange_n(&deferred_owner, &owner, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            if (owner == self)
+                return initialized;
+
+            pause();
+            owner = 0;
+        }
+
+        if (deferred_start < mem_size) {
+            pmm_init_deferred_step();
+            initialized = true;
+        }
+
+        __atomic_store_n(&deferred_owner, 0, __ATOMIC_RELEASE);
+    }
+
+    return initialized;
+}
+
+/*
+ * pmm_init_area
+ * carves the boot area out of a usable region, preferring memory above the DMA zone
+ * NOTE: the bootloader only maps the first 4 GiB, the area must lie below that until paging_init runs
+ * @param bytes : size of the area
+ */
+static void pmm_init_area(size_t bytes) {
+    paddr_t min_addrs[2] = { zone_type_start[PMM_ZONE_NORMAL], PAGE_SIZE };
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (uint64_t i = 0; i < boot_memmap->entries; i++) {
+            struct stivale2_mmap_entry entry = boot_memmap->memmap[i];
+            if (entry.type != MEM_USABLE) 
+                continue;
+
+            paddr_t entry_start = (paddr_t) ALIGN_UP(entry.base, 4 * KiB);
+            paddr_t entry_end = (paddr_t) ALIGN_DOWN(entry.base + entry.length, 4 * KiB);
+            entry_start = MAX(entry_start, min_addrs[pass]);
+            if (entry_start >= entry_end || entry_end - entry_start < bytes || entry_start + bytes > (uint64_t) 4 * GiB)
+                continue;
+
+            area_start = entry_start;
+            area_end = entry_start + bytes;
+            arena_init(&area_arena, (void*) P2V(area_start), bytes, 0);
+            return;
+        }
+    }
+
+    panic("pmm_init could not find 0x%lx bytes of memory for the page frame array and zone bitmaps.", bytes);
 }
 
 void pmm_init(struct stivale2_struct* handover) {
     // get memory map information from bootloader
-    struct stivale2_struct_tag_memmap* memmap = get_memmap(handover);
-    if (memmap == NULL)
+    boot_memmap = get_memmap(handover);
+    if (boot_memmap == NULL)
         panic("pmm_init could not find memory map from bootloader.");
 
     // verify at least 16 MiB of physical memory is present
-    mem_size = get_mem_size(memmap);
+    mem_size = get_mem_size(boot_memmap);
     if (mem_size < (16 * MiB))
         panic("pmm_init found less than 16 MiB of memory.");
 
-    // initialize zone structs
-    for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
-        if (zone == PMM_NUM_ZONES - 1) 
-            mem_zone[zone].mem_total = mem_size - mem_zone[zone].offset;
-        else 
-            mem_zone[zone].mem_total = mem_zone[zone + 1].offset - mem_zone[zone].offset;
+    // one colour per page of a cache way
+    if (PMM_COLOURING) {
+        size_t colours = cpuid_cache_way_size(PMM_CACHE_LEVEL) / PAGE_SIZE;
+        while (num_colours * 2 <= colours && num_colours * 2 <= PMM_MAX_COLOURS)
+            num_colours *= 2;
+
+        log("[pmm_init] page colours: %lu\n", num_colours);
+    }
+
+    // split memory into numa nodes
+    paddr_t node_start[SRAT_MAX_NODES];
+    paddr_t node_end[SRAT_MAX_NODES];
+    pmm_init_nodes(node_start, node_end);
+    pmm_init_fallback();
+
+    // zones are the parts of a node that lie within each zone type's range
+    num_pages = mem_size / PAGE_SIZE;
+    size_t area_bytes = ALIGN_UP(num_pages * sizeof(page_t), PAGE_SIZE);
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        log("[pmm_init] node %u: 0x%lx - 0x%lx\n", node, node_start[node], node_end[node]);
 
-        mem_zone[zone].mem_used = mem_zone[zone].mem_total;
-        mem_zone[zone].mem_free = 0;
-        mem_zone[zone].bitmap.size = mem_zone[zone].mem_total / PAGE_SIZE;
+        for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
+            zone_t* z = &mem_zone[node][zone];
+            paddr_t type_start = zone_type_start[zone];
+            paddr_t type_end = (zone + 1 == PMM_NUM_ZONES) ? mem_size : zone_type_start[zone + 1];
+            paddr_t start = MAX(node_start[node], type_start);
+            paddr_t end = MIN(node_end[node], type_end);
 
-        // init bitmaps
-        mem_zone[zone].bitmap.data = alloc(bitmap_size_bytes(&mem_zone[zone].bitmap), 8);
-        bitmap_set_range(&mem_zone[zone].bitmap, 0, mem_zone[zone].bitmap.size);
+            z->offset = start;
+            z->mem_total = (end > start) ? end - start : 0;
+            z->bitmap.size = z->mem_total / PAGE_SIZE;
+            area_bytes += bitmap_size_bytes(&z->bitmap) + bitmap_summary_size_bytes(&z->bitmap);
+        }
     }
 
-    // use bootloader handover information to set unused regions as usable
-    zone_e curr_zone = PMM_ZONE_DMA;
-    for (uint64_t i = 0; i < memmap->entries; i++) {
-        struct stivale2_mmap_entry entry = memmap->memmap[i];
-        if (entry.type == MEM_USABLE) {
-            paddr_t entry_start = (paddr_t) ALIGN_UP(entry.base, 4 * KiB);                    // inclusive 
-            paddr_t entry_end = (paddr_t) ALIGN_DOWN(entry.base + entry.length, 4 * KiB);     // exclusive
-
-            // find each zone the entry crosses over
-            paddr_t curr_zone_start = mem_zone[curr_zone].offset; 
-            paddr_t curr_zone_end = (curr_zone + 1 == PMM_NUM_ZONES) ? mem_size : mem_zone[curr_zone + 1].offset; 
-
-            // move curr_zone to where the entry starts
-            while (curr_zone_end < entry_start) {
-                curr_zone++;
-                curr_zone_start = mem_zone[curr_zone].offset; 
-                curr_zone_end = (curr_zone + 1 == PMM_NUM_ZONES) ? mem_size : mem_zone[curr_zone + 1].offset;
-            }
+    // page frame descriptors first, bitmaps behind them
+    pmm_init_area(ALIGN_UP(area_bytes, PAGE_SIZE));
+    // descriptors are initialized by pmm_init_descriptors
+    pmm_pages = (page_t*) arena_alloc(&area_arena, num_pages * sizeof(page_t), PAGE_SIZE);
+
+    // initialize zone structs
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        zero_pools[node].lock = (spinlock_t) SPINLOCK_INIT;
+
+        for (zone_e zone = 0; zone < PMM_NUM_ZONES; zone++) {
+            zone_t* z = &mem_zone[node][zone];
+
+            z->lock = (spinlock_t) SPINLOCK_INIT;
+            z->node = node;
+            z->zone = zone;
+            z->mem_used = z->mem_total;
+            z->mem_free = 0;
+            z->first_free_idx = (size_t) -1;
 
-            while (true) {
-                size_t idx = (entry_start - curr_zone_start) / PAGE_SIZE;
-                size_t size = (MIN(entry_end, curr_zone_end) - entry_start) / PAGE_SIZE;
-                pmm_set_unused(curr_zone, idx, size);
-
-                // update zone bookkeeping
-                mem_zone[curr_zone].mem_used -= size * PAGE_SIZE;
-                mem_zone[curr_zone].mem_free += size * PAGE_SIZE;
-                if (idx < mem_zone[curr_zone].first_free_idx)
-                    mem_zone[curr_zone].first_free_idx = idx;
-
-                // entry is within current zone
-                if (entry_end <= curr_zone_end)
-                    break;
-                
-                // entry bleeds into next zone
-                entry_start = MIN(curr_zone_end, entry_end);
-                curr_zone++;
-                curr_zone_start = (curr_zone + 1 > PMM_NUM_ZONES) ? mem_size : mem_zone[curr_zone].offset; 
-                curr_zone_end = (curr_zone + 1 >= PMM_NUM_ZONES) ? mem_size : mem_zone[curr_zone + 1].offset;
+            // init bitmaps, deferred memory stays used until it is registered
+            z->bitmap.data = (uint64_t*) alloc(bitmap_size_bytes(&z->bitmap), 8);
+            bitmap_set_range(&z->bitmap, 0, z->bitmap.size);
+            bitmap_summary_init(&z->bitmap, &z->summary, (uint64_t*) alloc(bitmap_summary_size_bytes(&z->bitmap), 8));
+
+            // init buddy free areas
+            for (uint8_t order = 0; order <= PMM_MAX_ORDER; order++) {
+                z->free_area[order].head = NULL;
+                z->free_area[order].num_free = 0;
             }
         }
     }
-}
 
+    // descriptors and free lists of memory above PMM_DEFER_START are left to pmm_init_deferred,
+    // which keeps boot time independent of the amount of memory
+    deferred_start = MIN(mem_size, PMM_DEFER_START);
+    deferred_desc = deferred_start;
+    pmm_init_descriptors(0, deferred_start);
+
+    // use bootloader handover information to set unused regions as usable
+    pmm_register_memmap(0, deferred_start);
+    if (deferred_start < mem_size)
+        log("[pmm_init] deferred initialization of 0x%lx - 0x%lx\n", deferred_start, mem_size);
+}
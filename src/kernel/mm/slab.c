@@ -0,0 +1,561 @@
+#include <mem/mem.h>
+#include <mm/slab.h>
+#include <mm/pmm.h>
+
+/* cache the kmem_cache_t structs of kmem_cache_create come from */
+static kmem_cache_t cache_cache;
+
+/* cache of magazines, its own objects are never cached in magazines */
+static kmem_cache_t magazine_cache;
+
+/*
+ * one cache per kmalloc size class
+ * NOTE: class i holds objects of SLAB_MIN_SIZE << i bytes
+ */
+static kmem_cache_t size_classes[SLAB_NUM_CLASSES];
+static const char* size_class_names[SLAB_NUM_CLASSES] = {
+    "kmalloc-8", "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+/* list of all caches */
+static kmem_cache_t* caches = NULL;
+static spinlock_t caches_lock = SPINLOCK_INIT;
+
+/* slab utility macros */
+#define obj_slab(obj)           ((slab_t*) addr_to_page(V2P((vaddr_t) (obj)))->owner)
+#define obj_next(cache, obj)    (*(void**) ((uint8_t*) (obj) + (cache)->link))
+
+/*
+ * size_class
+ * @param size : num bytes, at most SLAB_MAX_SIZE
+ * @returns index of the smallest size class that fits @param size
+ */
+static inline size_t size_class(size_t size) {
+    if (size <= SLAB_MIN_SIZE)
+        return 0;
+    return (64 - __builtin_clzl(size - 1)) - __builtin_ctzl(SLAB_MIN_SIZE);
+}
+
+/* slab list functions */
+static inline void slab_list_insert(slab_t** head, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head != NULL)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+static inline void slab_list_remove(slab_t** head, slab_t* slab) {
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/*
+ * slab_create
+ * allocates the page frames of a new slab for @param cache, constructs and threads all objects onto its free list
+ * @returns new slab
+ */
+static slab_t* slab_create(kmem_cache_t* cache) {
+    paddr_t frames = pmm_alloc(PMM_ZONE_NORMAL, cache->num_pages);
+    slab_t* slab = (slab_t*) P2V(frames);
+
+    // link frames to slab so objects find their slab without a header
+    for (size_t i = 0; i < cache->num_pages; i++)
+        addr_to_page(frames + i * PAGE_SIZE)->owner = slab;
+
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->cache = cache;
+    slab->num_free = cache->num_objs;
+
+    // objects are handed out in ascending order
+    uint8_t* obj = (uint8_t*) slab + cache->offset;
+    slab->free = obj;
+    for (size_t i = 0; i < cache->num_objs; i++, obj += cache->stride) {
+        if (cache->ctor)
+            cache->ctor(obj);
+        obj_next(cache, obj) = (i + 1 < cache->num_objs) ? obj + cache->stride : NULL;
+    }
+
+    cache->stats.num_slabs++;
+    return slab;
+}
+
+/*
+ * slab_destroy
+ * returns the page frames of a completely free @param slab to the pmm
+ */
+static inline void slab_destroy(slab_t* slab) {
+    pmm_free(V2P((vaddr_t) slab), slab->cache->num_pages);
+}
+
+/*
+ * kmem_cache_init
+ * sets up @param cache and adds it to the list of caches
+ * slabs grow by powers of 2 pages until at most 1/8th of a slab is wasted
+ * @param cache : cache to initialize
+ * @param name : name shown in statistics
+ * @param size : object size
+ * @param align : object alignment, power of 2 of at most PAGE_SIZE, 0 for SLAB_MIN_ALIGN
+ * @param ctor : object constructor, NULL if none
+ * @param magazines : serve allocations and frees from per-cpu magazines
+ */
+static void kmem_cache_init(kmem_cache_t* cache, const char* name, size_t size, size_t align, kmem_ctor_t ctor, bool magazines) {
+    if (size == 0)
+        panic("[kmem_cache_create] cache %s requested for objects of 0 bytes.", name);
+
+    if ((align & (align - 1)) || align > PAGE_SIZE)
+        panic("[kmem_cache_create] alignment of %lu bytes of cache %s is not a power of 2 of at most PAGE_SIZE.", align, name);
+
+    cache->lock = (spinlock_t) SPINLOCK_INIT;
+    cache->name = name;
+    cache->size = size;
+    cache->align = MAX(align, SLAB_MIN_ALIGN);
+    cache->ctor = ctor;
+    cache->partial = NULL;
+    cache->empty = NULL;
+    cache->stats = (kmem_stats_t) { 0 };
+    cache->magazines = magazines;
+    cache->depot_lock = (spinlock_t) SPINLOCK_INIT;
+    cache->depot_full = NULL;
+    cache->depot_num_full = 0;
+    cache->depot_empty = NULL;
+    memset(cache->cpu, 0, sizeof(cache->cpu));
+
+    // free objects are linked through their first word unless a constructor set up their contents
+    cache->link = ctor ? ALIGN_UP(size, sizeof(void*)) : 0;
+    cache->stride = ALIGN_UP(MAX(size, cache->link + sizeof(void*)), cache->align);
+    cache->offset = ALIGN_UP(sizeof(slab_t), cache->align);
+
+    if (cache->offset + cache->stride > SLAB_MAX_PAGES * PAGE_SIZE)
+        panic("[kmem_cache_create] objects of %lu bytes of cache %s do not fit in a slab.", size, name);
+
+    for (cache->num_pages = 1; ; cache->num_pages *= 2) {
+        size_t bytes = cache->num_pages * PAGE_SIZE;
+        cache->num_objs = (bytes - MIN(bytes, cache->offset)) / cache->stride;
+
+        size_t waste = bytes - cache->offset - cache->num_objs * cache->stride;
+        if (cache->num_objs && (waste <= bytes / 8 || cache->num_pages == SLAB_MAX_PAGES))
+            break;
+    }
+
+    uint64_t rflags = spin_lock_irqsave(&caches_lock);
+    cache->next = caches;
+    caches = cache;
+    spin_unlock_irqrestore(&caches_lock, rflags);
+}
+
+/*
+ * slab_cache_alloc
+ * takes an object from a partial slab of @param cache, a new slab is created if there is none
+ * @returns pointer to object
+ */
+static void* slab_cache_alloc(kmem_cache_t* cache) {
+    uint64_t rflags = spin_lock_irqsave(&cache->lock);
+
+    slab_t* slab = cache->partial;
+    if (slab == NULL) {
+        slab = cache->empty ? cache->empty : slab_create(cache);
+        cache->empty = NULL;
+        slab_list_insert(&cache->partial, slab);
+    }
+
+    void* obj = slab->free;
+    slab->free = obj_next(cache, obj);
+    slab->num_free--;
+
+    // full slabs leave the partial list until an object is freed
+    if (slab->num_free == 0)
+        slab_list_remove(&cache->partial, slab);
+
+    cache->stats.num_allocs++;
+    cache->stats.num_active++;
+
+    spin_unlock_irqrestore(&cache->lock, rflags);
+    return obj;
+}
+
+/*
+ * slab_cache_free
+ * returns @param obj to @param slab of @param cache, a slab that becomes free is kept or its frames go back to the pmm
+ */
+static void slab_cache_free(kmem_cache_t* cache, slab_t* slab, void* obj) {
+    slab_t* release = NULL;
+    uint64_t rflags = spin_lock_irqsave(&cache->lock);
+
+    bool was_full = slab->num_free == 0;
+    obj_next(cache, obj) = slab->free;
+    slab->free = obj;
+    slab->num_free++;
+
+    if (slab->num_free == cache->num_objs) {
+        // keep one free slab around to absorb alloc/free cycles at a slab boundary
+        if (!was_full)
+            slab_list_remove(&cache->partial, slab);
+
+        if (cache->empty == NULL) {
+            cache->empty = slab;
+        } else {
+            release = slab;
+            cache->stats.num_slabs--;
+        }
+    } else if (was_full) {
+        slab_list_insert(&cache->partial, slab);
+    }
+
+    cache->stats.num_frees++;
+    cache->stats.num_active--;
+
+    spin_unlock_irqrestore(&cache->lock, rflags);
+
+    if (release)
+        slab_destroy(release);
+}
+
+/*
+ * obj_valid
+ * @returns whether @param obj is the start of an object of @param slab
+ */
+static inline bool obj_valid(kmem_cache_t* cache, slab_t* slab, void* obj) {
+    if (slab == NULL || slab->cache != cache)
+        return false;
+
+    return (vaddr_t) obj >= (vaddr_t) slab + cache->offset && ((vaddr_t) obj - (vaddr_t) slab - cache->offset) % cache->stride == 0;
+}
+
+/*
+ * magazine_empty
+ * returns all objects of @param mag to their slabs, leaving @param mag empty
+ */
+static void magazine_empty(kmem_cache_t* cache, kmem_magazine_t* mag) {
+    for (size_t i = 0; i < mag->rounds; i++)
+        slab_cache_free(cache, obj_slab(mag->objs[i]), mag->objs[i]);
+
+    mag->rounds = 0;
+}
+
+/*
+ * magazine_drain
+ * returns all objects of @param mag to their slabs and frees @param mag
+ */
+static void magazine_drain(kmem_cache_t* cache, kmem_magazine_t* mag) {
+    if (mag == NULL)
+        return;
+
+    magazine_empty(cache, mag);
+    kmem_cache_free(&magazine_cache, mag);
+}
+
+/*
+ * magazine_alloc
+ * takes an object from the magazines of @param cc, swapping in a full magazine from the depot if both are empty
+ * NOTE: interrupts must be disabled
+ * @returns pointer to object or NULL if the depot has no full magazine
+ */
+static void* magazine_alloc(kmem_cache_t* cache, kmem_cpu_cache_t* cc) {
+    kmem_magazine_t* mag = cc->loaded;
+    if (mag != NULL && mag->rounds)
+        return mag->objs[--mag->rounds];
+
+    // previous magazine is full
+    if (cc->prev != NULL && cc->prev->rounds) {
+        cc->loaded = cc->prev;
+        cc->prev = mag;
+        return cc->loaded->objs[--cc->loaded->rounds];
+    }
+
+    // exchange the empty magazine for a full one
+    spin_lock(&cache->depot_lock);
+    kmem_magazine_t* full = cache->depot_full;
+    if (full != NULL) {
+        cache->depot_full = full->next;
+        cache->depot_num_full--;
+        if (cc->prev != NULL) {
+            cc->prev->next = cache->depot_empty;
+            cache->depot_empty = cc->prev;
+        }
+
+        cc->prev = cc->loaded;
+        cc->loaded = full;
+    }
+    spin_unlock(&cache->depot_lock);
+
+    return full ? full->objs[--full->rounds] : NULL;
+}
+
+/*
+ * magazine_free
+ * puts @param obj in the magazines of @param cc, swapping in an empty magazine if both are full
+ * NOTE: interrupts must be disabled
+ */
+static void magazine_free(kmem_cache_t* cache, kmem_cpu_cache_t* cc, void* obj) {
+    kmem_magazine_t* mag = cc->loaded;
+    if (mag != NULL && mag->rounds < KMEM_MAG_SIZE) {
+        mag->objs[mag->rounds++] = obj;
+        return;
+    }
+
+    // previous magazine is empty
+    if (cc->prev != NULL && cc->prev->rounds == 0) {
+        cc->loaded = cc->prev;
+        cc->prev = mag;
+        cc->loaded->objs[cc->loaded->rounds++] = obj;
+        return;
+    }
+
+    // exchange the full magazine for an empty one, the depot keeps at most KMEM_DEPOT_MAX full magazines
+    kmem_magazine_t* empty = NULL;
+    kmem_magazine_t* excess = NULL;
+    spin_lock(&cache->depot_lock);
+    if (cc->prev != NULL && cache->depot_num_full >= KMEM_DEPOT_MAX) {
+        excess = cc->prev;
+    } else {
+        empty = cache->depot_empty;
+        if (empty != NULL)
+            cache->depot_empty = empty->next;
+
+        if (cc->prev != NULL) {
+            cc->prev->next = cache->depot_full;
+            cache->depot_full = cc->prev;
+            cache->depot_num_full++;
+        }
+    }
+    spin_unlock(&cache->depot_lock);
+
+    // objects of a magazine the depot has no room for go back to their slabs, the magazine is reused as the empty one
+    if (excess != NULL) {
+        magazine_empty(cache, excess);
+        empty = excess;
+    } else if (empty == NULL) {
+        empty = CAST(kmem_cache_alloc(&magazine_cache), kmem_magazine_t*);
+        empty->rounds = 0;
+    }
+
+    cc->prev = cc->loaded;
+    cc->loaded = empty;
+    empty->objs[empty->rounds++] = obj;
+}
+
+/*
+ * kmem_cache_alloc
+ * allocates an object from @param cache
+ * the per-cpu magazines serve most allocations without any atomic operation, the slab layer is the fallback
+ * @returns pointer to object
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    void* obj = NULL;
+    uint64_t rflags;
+    dump_rflags(rflags);
+    cli();
+
+    kmem_cpu_cache_t* cc = &cache->cpu[smp_cpu_id()];
+    cc->num_allocs++;
+    if (cache->magazines)
+        obj = magazine_alloc(cache, cc);
+
+    load_rflags(rflags);
+
+    if (obj == NULL)
+        obj = slab_cache_alloc(cache);
+
+    return obj;
+}
+
+/*
+ * cache_free
+ * returns @param obj to the magazines of the current processor or, for caches without magazines, to its slab
+ */
+static void cache_free(kmem_cache_t* cache, slab_t* slab, void* obj) {
+    // verify obj is the start of an object, bad pointers must not end up in a magazine
+    if (!obj_valid(cache, slab, obj)) {
+        error("[kmem_cache_free] free request on address that is not an object of cache %s, addr: 0x%lx\n", cache->name, obj);
+        return;
+    }
+
+    uint64_t rflags;
+    dump_rflags(rflags);
+    cli();
+
+    kmem_cpu_cache_t* cc = &cache->cpu[smp_cpu_id()];
+    cc->num_frees++;
+    if (cache->magazines)
+        magazine_free(cache, cc, obj);
+
+    load_rflags(rflags);
+
+    if (!cache->magazines)
+        slab_cache_free(cache, slab, obj);
+}
+
+/*
+ * kmem_cache_free
+ * returns @param obj to @param cache
+ * @param obj : object from kmem_cache_alloc on @param cache
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    cache_free(cache, obj_slab(obj), obj);
+}
+
+/*
+ * kmem_cache_create
+ * creates a cache of objects of @param size bytes
+ * @param name : name shown in statistics, must outlive the cache
+ * @param size : object size
+ * @param align : object alignment, power of 2 of at most PAGE_SIZE, 0 for SLAB_MIN_ALIGN
+ * @param ctor : object constructor, NULL if none
+ * @returns new cache
+ */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor_t ctor) {
+    kmem_cache_t* cache = CAST(kmem_cache_alloc(&cache_cache), kmem_cache_t*);
+    kmem_cache_init(cache, name, size, align, ctor, true);
+    return cache;
+}
+
+/*
+ * kmem_cache_lazy
+ * creates the cache in @param cache on first use, for users without an init hook (i.e. library data structures)
+ * @param cache : where the cache is kept, NULL until created
+ * @returns *@param cache
+ */
+kmem_cache_t* kmem_cache_lazy(kmem_cache_t** cache, const char* name, size_t size, size_t align, kmem_ctor_t ctor) {
+    kmem_cache_t* curr = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+    if (curr != NULL)
+        return curr;
+
+    // another processor may create the cache at the same time, only one of them is kept
+    kmem_cache_t* new_cache = kmem_cache_create(name, size, align, ctor);
+    if (!__atomic_compare_exchange_n(cache, &curr, new_cache, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        kmem_cache_destroy(new_cache);
+        return curr;
+    }
+
+    return new_cache;
+}
+
+/*
+ * kmem_cache_destroy
+ * frees @param cache, all of its objects must have been freed
+ * NOTE: no processor may use @param cache anymore
+ */
+void kmem_cache_destroy(kmem_cache_t* cache) {
+    // objects cached in magazines go back to their slabs first
+    for (size_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        magazine_drain(cache, cache->cpu[cpu].loaded);
+        magazine_drain(cache, cache->cpu[cpu].prev);
+        cache->cpu[cpu].loaded = cache->cpu[cpu].prev = NULL;
+    }
+
+    uint64_t rflags = spin_lock_irqsave(&cache->depot_lock);
+    kmem_magazine_t* full = cache->depot_full;
+    kmem_magazine_t* empty_mags = cache->depot_empty;
+    cache->depot_full = cache->depot_empty = NULL;
+    cache->depot_num_full = 0;
+    spin_unlock_irqrestore(&cache->depot_lock, rflags);
+
+    for (kmem_magazine_t* next; full != NULL; full = next) {
+        next = full->next;
+        magazine_drain(cache, full);
+    }
+    for (kmem_magazine_t* next; empty_mags != NULL; empty_mags = next) {
+        next = empty_mags->next;
+        magazine_drain(cache, empty_mags);
+    }
+
+    rflags = spin_lock_irqsave(&cache->lock);
+    if (cache->stats.num_active) {
+        spin_unlock_irqrestore(&cache->lock, rflags);
+        error("[kmem_cache_destroy] cache %s still has %lu objects in use.\n", cache->name, cache->stats.num_active);
+        return;
+    }
+
+    slab_t* empty = cache->empty;
+    cache->empty = NULL;
+    spin_unlock_irqrestore(&cache->lock, rflags);
+
+    if (empty)
+        slab_destroy(empty);
+
+    // remove cache from list of caches
+    rflags = spin_lock_irqsave(&caches_lock);
+    kmem_cache_t** curr = &caches;
+    while (*curr != cache)
+        curr = &(*curr)->next;
+    *curr = cache->next;
+    spin_unlock_irqrestore(&caches_lock, rflags);
+
+    kmem_cache_free(&cache_cache, cache);
+}
+
+/*
+ * slab_alloc
+ * allocates an object of the smallest size class that fits @param size bytes
+ * @param size : num bytes, at most SLAB_MAX_SIZE
+ * @returns pointer to object
+ */
+void* slab_alloc(size_t size) {
+    if (size > SLAB_MAX_SIZE)
+        panic("[slab_alloc] request of %lu bytes exceeds largest size class.", size);
+
+    return kmem_cache_alloc(&size_classes[size_class(size)]);
+}
+
+/*
+ * slab_free
+ * returns @param obj to the cache it was allocated from
+ * @param obj : object from slab_alloc or kmem_cache_alloc
+ */
+void slab_free(void* obj) {
+    slab_t* slab = obj_slab(obj);
+    cache_free(slab->cache, slab, obj);
+}
+
+/*
+ * slab_size
+ * @returns usable size of @param obj
+ */
+size_t slab_size(void* obj) {
+    return obj_slab(obj)->cache->size;
+}
+
+/*
+ * slab_init
+ * initializes the cache of caches, the magazine cache and the kmalloc size classes
+ */
+void slab_init(void) {
+    kmem_cache_init(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0, NULL, true);
+    kmem_cache_init(&magazine_cache, "kmem_magazine", sizeof(kmem_magazine_t), 0, NULL, false);
+
+    for (size_t i = 0; i < SLAB_NUM_CLASSES; i++) {
+        size_t size = SLAB_MIN_SIZE << i;
+        kmem_cache_init(&size_classes[i], size_class_names[i], size, MIN(size, SLAB_ALIGN), NULL, true);
+    }
+}
+
+/* for debugging */
+void parse_caches(void) {
+    info("parsing kmem caches ...\n");
+
+    uint64_t rflags = spin_lock_irqsave(&caches_lock);
+    for (kmem_cache_t* curr = caches; curr != NULL; curr = curr->next) {
+        size_t allocs = 0;
+        size_t frees = 0;
+        for (size_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            allocs += curr->cpu[cpu].num_allocs;
+            frees += curr->cpu[cpu].num_frees;
+        }
+
+        log("[parse_caches] %s: size: %lu, stride: %lu, objs/slab: %lu, pages/slab: %lu, slabs: %lu, allocs: %lu, frees: %lu, in use: %lu, slab allocs: %lu, slab frees: %lu, cached: %lu\n",
+            curr->name, curr->size, curr->stride, curr->num_objs, curr->num_pages, curr->stats.num_slabs,
+            allocs, frees, allocs - frees, curr->stats.num_allocs, curr->stats.num_frees, curr->stats.num_active - (allocs - frees));
+    }
+    spin_unlock_irqrestore(&caches_lock, rflags);
+}
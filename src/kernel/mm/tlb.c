@@ -0,0 +1,210 @@
+#include <mm/tlb.h>
+#include <intr/lapic.h>
+#include <intr/interrupt.h>
+#include <log.h>
+
+/*
+ * General notes:
+ * - kernel_space mappings are global and shared by all address spaces, its batches go to every online processor
+ * - other address spaces only reach the processors running them, processors that merely cache entries of
+ *   the space's pcid lose their bit in tlb_cpus and flush the pcid when they switch to the space again
+ * - processors join shootdowns with tlb_cpu_online once they run the kernel idt and lapic
+ * - waiting for acknowledgements with interrupts disabled deadlocks if the target waits on the initiator
+ */
+
+static tlb_mailbox_t mailboxes[SMP_MAX_CPUS];
+static uint8_t cpu_lapics[SMP_MAX_CPUS];        /* lapic id of each online processor, indexed by logical id */
+static volatile uint64_t online_cpus = 0;       /* processors taking shootdown IPIs, one bit per logical id */
+
+/*
+ * tlb_init
+ * registers the shootdown interrupt handler and takes the current processor online
+ * NOTE: the lapic must be enabled
+ */
+void tlb_init(void) {
+    register_intr_handler(&wrapper_tlb_intr_handler, TLB_INTR_VEC);
+    tlb_cpu_online();
+}
+
+/*
+ * tlb_cpu_online
+ * lets the current processor take part in tlb shootdowns
+ */
+void tlb_cpu_online(void) {
+    uint32_t cpu = smp_cpu_id();
+    cpu_lapics[cpu] = lapic_id();
+    __atomic_fetch_or(&online_cpus, (uint64_t) 1 << cpu, __ATOMIC_SEQ_CST);
+    log("[tlb_cpu_online] processor %u takes tlb shootdowns\n", cpu);
+}
+
+/*
+ * tlb_flush_all
+ * flushes the whole tlb of the current processor
+ * @param global : whether global entries are flushed too
+ */
+static void tlb_flush_all(bool global) {
+    uint64_t cr4;
+    dump_cr4(cr4);
+
+    // toggling CR4.PGE flushes every entry of every pcid
+    if (global && (cr4 & CR4_PGE)) {
+        load_cr4(cr4 & ~CR4_PGE);
+        load_cr4(cr4);
+        return;
+    }
+
+    // reloading cr3 without CR3_NOFLUSH flushes the non-global entries of the current pcid
+    uint64_t cr3;
+    dump_cr3(cr3);
+    load_cr3(cr3);
+}
+
+/*
+ * tlb_flush_local
+ * carries out @param batch on the current processor
+ */
+static void tlb_flush_local(tlb_batch_t* batch) {
+    bool kernel = (batch->space == &kernel_space);
+
+    // invlpg only reaches the current pcid, an inactive space was dropped from tlb_cpus instead
+    if (!kernel && paging_current_space() != batch->space)
+        return;
+
+    if (batch->full) {
+        tlb_flush_all(kernel);
+        return;
+    }
+
+    for (size_t i = 0; i < batch->num_ranges; i++) {
+        for (uint64_t j = 0; j < batch->ranges[i].num; j++)
+            invlpg(batch->ranges[i].start + j * PAGE_SIZE);
+    }
+}
+
+/*
+ * tlb_batch_add
+ * adds @param num pages from @param start on to @param batch
+ * batches of more than TLB_FLUSH_THRESHOLD pages or TLB_BATCH_RANGES ranges flush the whole tlb
+ */
+void tlb_batch_add(tlb_batch_t* batch, vaddr_t start, uint64_t num) {
+    start = ALIGN_DOWN(start, PAGE_SIZE);
+    batch->num_pages += num;
+    if (batch->full || num == 0)
+        return;
+
+    // extend the last range if the new one follows it
+    tlb_range_t* last = batch->num_ranges ? &batch->ranges[batch->num_ranges - 1] : NULL;
+    if (last != NULL && last->start + last->num * PAGE_SIZE == start)
+        last->num += num;
+    else if (batch->num_ranges < TLB_BATCH_RANGES)
+        batch->ranges[batch->num_ranges++] = (tlb_range_t) { .start = start, .num = num };
+    else
+        batch->full = true;
+
+    if (batch->num_pages > TLB_FLUSH_THRESHOLD)
+        batch->full = true;
+}
+
+/*
+ * tlb_batch_flush
+ * carries out @param batch on every processor that may cache its entries
+ * returns once the IPIs are sent and the local tlb is flushed, use tlb_batch_wait before page frames or
+ * tables of the batch are reused
+ * NOTE: a processor has at most one batch in flight and one more from interrupt context, so mailboxes of
+ * TLB_QUEUE_SIZE never fill up. the initiator may hold a lock a target spins on, it must never wait here
+ */
+void tlb_batch_flush(tlb_batch_t* batch) {
+    if (batch->num_ranges == 0 && !batch->full)
+        return;
+
+    uint32_t self = smp_cpu_id();
+    uint64_t self_bit = (uint64_t) 1 << self;
+    uint64_t targets;
+
+    if (batch->space == &kernel_space) {
+        targets = __atomic_load_n(&online_cpus, __ATOMIC_SEQ_CST);
+    } else {
+        // drop processors from tlb_cpus before looking at active_cpus, paging_switch sets them in the other order
+        uint64_t keep = (paging_current_space() == batch->space) ? self_bit : 0;
+        __atomic_fetch_and(&batch->space->tlb_cpus, keep, __ATOMIC_SEQ_CST);
+        targets = __atomic_load_n(&batch->space->active_cpus, __ATOMIC_SEQ_CST) & __atomic_load_n(&online_cpus, __ATOMIC_SEQ_CST);
+    }
+    targets &= ~self_bit;
+
+    // pending is set before any target can acknowledge
+    uint32_t num_targets = 0;
+    for (uint64_t mask = targets; mask; mask &= mask - 1)
+        num_targets++;
+    batch->pending = num_targets;
+
+    for (uint64_t mask = targets; mask; mask &= mask - 1) {
+        uint32_t cpu = __builtin_ctzl(mask);
+        tlb_mailbox_t* box = &mailboxes[cpu];
+
+        uint64_t rflags = spin_lock_irqsave(&box->lock);
+        if (box->num == TLB_QUEUE_SIZE)
+            panic("[tlb_batch_flush] mailbox of processor %u is full", cpu);
+        box->queue[box->num++] = batch;
+        spin_unlock_irqrestore(&box->lock, rflags);
+
+        ipi_t ipi = {
+            .vector         = TLB_INTR_VEC,
+            .delivery_mode  = IPI_FIXED,
+            .dest_mode      = IPI_PHYS,
+            .level          = IPI_ASSERT,
+            .trigger_mode   = IPI_EDGE,
+            .dest_shorthand = IPI_NO_SH,
+            .destination    = cpu_lapics[cpu]
+        };
+        lapic_ipi(ipi);
+    }
+
+    tlb_flush_local(batch);
+}
+
+/*
+ * tlb_batch_wait
+ * waits until every processor @param batch was sent to acknowledged it
+ */
+void tlb_batch_wait(tlb_batch_t* batch) {
+    while (__atomic_load_n(&batch->pending, __ATOMIC_ACQUIRE))
+        pause();
+}
+
+/*
+ * tlb_poll
+ * carries out the batches sent to the current processor and acknowledges them without waiting for their IPIs
+ * NOTE: batches are queued before tlb_batch_flush returns, code running with interrupts disabled polls before
+ * it reuses virtual addresses another processor unmapped and flushed under the same lock
+ */
+void tlb_poll(void) {
+    tlb_mailbox_t* box = &mailboxes[smp_cpu_id()];
+
+    for (;;) {
+        uint64_t rflags = spin_lock_irqsave(&box->lock);
+        if (box->num == 0) {
+            spin_unlock_irqrestore(&box->lock, rflags);
+            break;
+        }
+        tlb_batch_t* batch = box->queue[--box->num];
+        spin_unlock_irqrestore(&box->lock, rflags);
+
+        tlb_flush_local(batch);
+
+        // entries of the space's pcid are current again
+        if (batch->space != &kernel_space && paging_current_space() == batch->space)
+            __atomic_fetch_or(&batch->space->tlb_cpus, (uint64_t) 1 << smp_cpu_id(), __ATOMIC_SEQ_CST);
+
+        // the batch may be gone once it is acknowledged
+        __atomic_fetch_sub(&batch->pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * tlb_intr_handler
+ * carries out the batches sent to the current processor, a batch polled before its IPI arrived is already done
+ */
+void tlb_intr_handler(void) {
+    tlb_poll();
+    lapic_eoi(TLB_INTR_VEC);
+}
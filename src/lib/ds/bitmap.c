@@ -2,8 +2,188 @@
 #include <ds/bitmap.h>
 
 /* 
+ * bitmap_range_mask
+ * @param start : first bit of mask within word
+ * @param num : number of bits in mask
+ * @returns word with bits [@param start, @param start + @param num) set
+ */
+static inline uint64_t bitmap_range_mask(size_t start, size_t num) {
+    uint64_t mask = (num >= BITMAP_WORD_BITS) ? BITMAP_WORD_FULL : (((uint64_t) 1 << num) - 1);
+    return mask << start;
+}
+
+/*
+ * bitmap_word_mask
+ * @returns mask of the bits of @param word that lie within @param bitmap
+ */
+static inline uint64_t bitmap_word_mask(bitmap_t* bitmap, size_t word) {
+    if (word == get_word_index(bitmap->size - 1))
+        return bitmap_range_mask(0, bitmap->size - word * BITMAP_WORD_BITS);
+    return BITMAP_WORD_FULL;
+}
+
+/*
+ * bitmap_summarize_level
+ * recomputes the bits of @param summary that describe words [@param first_word, @param last_word] of @param below
+ * @param below : bitmap (or summary level) that changed
+ * @param summary : level directly above @param below
+ * @param full : summarize words that are all 1's or all 0's
+ */
+static void bitmap_summarize_level(bitmap_t* below, bitmap_t* summary, size_t first_word, size_t last_word, bool full) {
+    for (size_t word = first_word; word <= last_word; word++) {
+        uint64_t mask = bitmap_word_mask(below, word);
+        uint64_t w = below->data[word] & mask;
+
+        if (w == (full ? mask : 0))
+            bitmap_set(summary, word);
+        else
+            bitmap_clear(summary, word);
+    }
+}
+
+/*
+ * bitmap_summarize
+ * updates every summary level after words [@param first_word, @param last_word] of @param bitmap changed
+ */
+void bitmap_summarize(bitmap_t* bitmap, size_t first_word, size_t last_word) {
+    bitmap_summary_t* summary = bitmap->summary;
+
+    bitmap_summarize_level(bitmap, &summary->full[0], first_word, last_word, true);
+    bitmap_summarize_level(bitmap, &summary->empty[0], first_word, last_word, false);
+
+    for (size_t level = 1; level < BITMAP_SUMMARY_LEVELS; level++) {
+        first_word = get_word_index(first_word);
+        last_word = get_word_index(last_word);
+
+        bitmap_summarize_level(&summary->full[level - 1], &summary->full[level], first_word, last_word, true);
+        bitmap_summarize_level(&summary->empty[level - 1], &summary->empty[level], first_word, last_word, true);
+    }
+}
+
+/*
+ * bitmap_summary_init
+ * attaches @param summary to @param bitmap and computes it from the current contents
+ * @param buf : storage for the summary levels, must be bitmap_summary_size_bytes(@param bitmap) bytes
+ */
+void bitmap_summary_init(bitmap_t* bitmap, bitmap_summary_t* summary, uint64_t* buf) {
+    size_t bits = bitmap_size_words(bitmap);
+
+    for (size_t level = 0; level < BITMAP_SUMMARY_LEVELS; level++) {
+        summary->full[level] = (bitmap_t) { .size = bits, .data = buf, .summary = NULL };
+        buf += bitmap_size_words(&summary->full[level]);
+        summary->empty[level] = (bitmap_t) { .size = bits, .data = buf, .summary = NULL };
+        buf += bitmap_size_words(&summary->empty[level]);
+
+        bits = bitmap_size_words(&summary->full[level]);
+    }
+
+    bitmap->summary = summary;
+    if (bitmap->size)
+        bitmap_summarize(bitmap, 0, bitmap_size_words(bitmap) - 1);
+}
+
+/*
+ * bitmap_run_length
+ * counts consecutive 1's in @param levels[0] from @param start, using the levels above to skip whole words
+ * @param levels : summary levels, lowest first
+ * @param num_levels : number of levels in @param levels
+ * @param start : first bit to count
+ * @param end : stop counting at this bit (exclusive)
+ */
+static size_t bitmap_run_length(bitmap_t* levels, size_t num_levels, size_t start, size_t end) {
+    bitmap_t* level = &levels[0];
+    size_t curr = start;
+
+    while (curr < end) {
+        // skip words that are all 1's
+        if (num_levels > 1 && get_bit_index(curr) == 0) {
+            curr += bitmap_run_length(levels + 1, num_levels - 1, get_word_index(curr), get_word_index(end)) * BITMAP_WORD_BITS;
+            if (curr >= end)
+                break;
+        }
+
+        uint64_t rest = level->data[get_word_index(curr)] >> get_bit_index(curr);
+        size_t ones = (~rest) ? __builtin_ctzl(~rest) : BITMAP_WORD_BITS;
+
+        curr += ones;
+        if (ones == 0 || get_bit_index(curr) != 0)
+            break;
+    }
+
+    return MIN(curr, end) - start;
+}
+
+/*
+ * bitmap_fill_range
+ * sets or clears @param num_bits starting from @param bit, whole words are written at once
+ * @param bitmap : bitmap to fill
+ * @param bit : first bit to fill
+ * @param num_bits : number of bits to fill
+ * @param val : fill with 1's or 0's
+ */
+static inline void bitmap_fill_range(bitmap_t* bitmap, size_t bit, size_t num_bits, bool val) {
+    size_t word = get_word_index(bit);
+    size_t offset = get_bit_index(bit);
+
+    if (num_bits == 0)
+        return;
+
+    const size_t first_word = word;
+    const size_t last_word = get_word_index(bit + num_bits - 1);
+
+    // leading partial word
+    if (offset) {
+        size_t num = MIN(num_bits, BITMAP_WORD_BITS - offset);
+        uint64_t mask = bitmap_range_mask(offset, num);
+
+        if (val)
+            bitmap->data[word] |= mask;
+        else
+            bitmap->data[word] &= ~mask;
+
+        num_bits -= num;
+        word++;
+    }
+
+    // whole words
+    for ( ; num_bits >= BITMAP_WORD_BITS; num_bits -= BITMAP_WORD_BITS)
+        bitmap->data[word++] = val ? BITMAP_WORD_FULL : 0;
+
+    // trailing partial word
+    if (num_bits) {
+        uint64_t mask = bitmap_range_mask(0, num_bits);
+
+        if (val)
+            bitmap->data[word] |= mask;
+        else
+            bitmap->data[word] &= ~mask;
+    }
+
+    if (bitmap->summary)
+        bitmap_summarize(bitmap, first_word, last_word);
+}
+
+/*
+ * bitmap_set_range
+ * sets @param num_bits bits starting from @param bit
+ */
+void bitmap_set_range(bitmap_t* bitmap, size_t bit, size_t num_bits) {
+    bitmap_fill_range(bitmap, bit, num_bits, true);
+}
+
+/*
+ * bitmap_clear_range
+ * clears @param num_bits bits starting from @param bit
+ */
+void bitmap_clear_range(bitmap_t* bitmap, size_t bit, size_t num_bits) {
+    bitmap_fill_range(bitmap, bit, num_bits, false);
+}
+
+/*
  * bitmap_find_range
  * finds a range of @param bits with @param length starting from @param first_idx
+ * words that are entirely (not) @param bit are skipped, runs within a word are found with bit scans
+ * if @param bitmap is summarized, long stretches of such words are skipped through the summary levels
  * @param bitmap : bitmap to search in
  * @param first_idx : idx to start searching from
  * @param bit : search for range of 1's or 0's
@@ -13,20 +193,76 @@ size_t bitmap_find_range(bitmap_t* bitmap, size_t first_idx, bool bit, size_t le
     size_t found_length = 0;
     size_t found_idx = (size_t) -1;
 
-    for (size_t idx = first_idx; idx < bitmap->size; idx++) {
-        if (bitmap_get(bitmap, idx) == bit) {
+    if (length == 0 || first_idx >= bitmap->size)
+        return (size_t) -1;
+
+    const size_t first_word = get_word_index(first_idx);
+    const size_t last_word = get_word_index(bitmap->size - 1);
+
+    for (size_t word = first_word; word <= last_word; word++) {
+        // let the summary skip words that are entirely (not) @param bit, the first and last word are masked below
+        if (bitmap->summary && word != first_word && word != last_word) {
+            bitmap_summary_t* summary = bitmap->summary;
+
+            if (found_length == 0) {
+                word += bitmap_run_length(bit ? summary->empty : summary->full, BITMAP_SUMMARY_LEVELS, word, last_word);
+            } else {
+                size_t words = bitmap_run_length(bit ? summary->full : summary->empty, BITMAP_SUMMARY_LEVELS, word, last_word);
+
+                found_length += words * BITMAP_WORD_BITS;
+                if (found_length >= length)
+                    return found_idx;
+
+                word += words;
+            }
+        }
+
+        // search for 1's, ignoring bits before first_idx and past the end of the bitmap
+        uint64_t w = bit ? bitmap->data[word] : ~bitmap->data[word];
+        if (word == first_word)
+            w &= bitmap_range_mask(get_bit_index(first_idx), BITMAP_WORD_BITS - get_bit_index(first_idx));
+        if (word == last_word)
+            w &= bitmap_range_mask(0, bitmap->size - word * BITMAP_WORD_BITS);
+
+        // whole word extends the current range
+        if (w == BITMAP_WORD_FULL) {
             if (found_length == 0)
-                found_idx = idx;
+                found_idx = word * BITMAP_WORD_BITS;
 
-            found_length++;
+            found_length += BITMAP_WORD_BITS;
+            if (found_length >= length)
+                return found_idx;
 
-        } else {
-            found_length = 0;
-            found_idx = (size_t) -1; 
+            continue;
         }
 
-        if (found_length == length) 
-            return found_idx; 
+        size_t pos = 0;
+        while (pos < BITMAP_WORD_BITS) {
+            uint64_t rest = w >> pos;
+            if (rest == 0) {
+                found_length = 0;
+                break;
+            }
+
+            // 0's end the current range
+            size_t zeroes = __builtin_ctzl(rest);
+            if (zeroes) {
+                found_length = 0;
+                pos += zeroes;
+                rest >>= zeroes;
+            }
+
+            // count 1's
+            size_t ones = __builtin_ctzl(~rest);
+            if (found_length == 0)
+                found_idx = word * BITMAP_WORD_BITS + pos;
+
+            found_length += ones;
+            if (found_length >= length)
+                return found_idx;
+
+            pos += ones;
+        }
     }
 
     return (size_t) -1;
@@ -1,5 +1,6 @@
 #include <ds/queue.h>
 #include <mm/kheap.h>
+#include <mm/slab.h>
 #include <mem/mem.h>
 #include <log.h>
 
@@ -12,6 +13,12 @@
  *  back                         front
  */
 
+/* queue_t headers (aligned so no header straddles a cache line) and list nodes */
+static kmem_cache_t* queue_cache = NULL;
+static kmem_cache_t* qnode_cache = NULL;
+#define get_queue_cache()   kmem_cache_lazy(&queue_cache, "queue_t", sizeof(queue_t), 32, NULL)
+#define get_qnode_cache()   kmem_cache_lazy(&qnode_cache, "qnode_t", sizeof(qnode_t), 0, NULL)
+
 /* 
  * queue_create
  * creates a new queue
@@ -19,7 +26,7 @@
  * @returns pointer to new queue
  */
 queue_t* queue_create(size_t data_size) {
-    queue_t* q = CAST(kmalloc(sizeof(queue_t)), queue_t*);
+    queue_t* q = CAST(kmem_cache_alloc(get_queue_cache()), queue_t*);
     q->head = NULL;
     q->tail = NULL;
     q->data_size = data_size;
@@ -38,11 +45,11 @@ void queue_destroy(queue_t* q) {
     for (size_t i = 0; i < q->size; i++) {
        q->head = q->head->next;
        kfree(temp->data);
-       kfree(temp);
+       kmem_cache_free(get_qnode_cache(), temp);
        temp = q->head;
     }
 
-    kfree(q);
+    kmem_cache_free(get_queue_cache(), q);
 }
 
 /* 
@@ -92,8 +99,11 @@ void queue_dequeue(queue_t* q) {
 
     if (prev != NULL)
         prev->next = NULL;
+    else
+        q->head = NULL;
 
-    kfree(q->tail);
+    kfree(q->tail->data);
+    kmem_cache_free(get_qnode_cache(), q->tail);
     q->tail = prev;
     q->size--;
 }
@@ -104,7 +114,7 @@ void queue_dequeue(queue_t* q) {
  * @param q : queue to enqueue from
  */
 void queue_enqueue(queue_t* q, void* data) {
-    qnode_t* node = CAST(kmalloc(sizeof(qnode_t)), qnode_t*);
+    qnode_t* node = CAST(kmem_cache_alloc(get_qnode_cache()), qnode_t*);
     node->prev = NULL;
     node->data = kmalloc(q->data_size);
     memcpy(node->data, data, q->data_size);
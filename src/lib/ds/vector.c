@@ -1,9 +1,14 @@
 #include <ds/vector.h>
 
 #include <mm/kheap.h>
+#include <mm/slab.h>
 #include <mem/mem.h>
 #include <log.h>
 
+/* vector_t headers, aligned so no header straddles a cache line */
+static kmem_cache_t* vector_cache = NULL;
+#define get_vector_cache()  kmem_cache_lazy(&vector_cache, "vector_t", sizeof(vector_t), 32, NULL)
+
 /* returns the address of an element in vector */
 #define get_elem_addr(vec, idx) CAST(CAST(vec->buf, uint8_t*) + ((idx) * vec->data_size), void*) 
 
@@ -16,7 +21,7 @@
  * @returns pointer to newly created vector
  */
 inline vector_t* vector_create(size_t data_size, size_t capacity) {
-    vector_t* vec = CAST(kmalloc(sizeof(vector_t)), vector_t*);
+    vector_t* vec = CAST(kmem_cache_alloc(get_vector_cache()), vector_t*);
     vec->capacity = capacity;
     vec->size = 0;
     vec->data_size = data_size;
@@ -31,7 +36,7 @@ inline vector_t* vector_create(size_t data_size, size_t capacity) {
  */
 inline void vector_destroy(vector_t* vec) {
     kfree(vec->buf);
-    kfree(vec);
+    kmem_cache_free(get_vector_cache(), vec);
 }
 
 /* 
@@ -1,46 +1,85 @@
 #pragma once
 
-#define get_byte_index(bit) (bit / 8)
-#define get_bit_index(bit) (bit % 8)
+/* bitmaps are stored as 64-bit words so ranges can be scanned and filled a word at a time */
+#define BITMAP_WORD_BITS        64
+#define BITMAP_WORD_FULL        (~((uint64_t) 0))
+
+#define get_word_index(bit) ((bit) / BITMAP_WORD_BITS)
+#define get_bit_index(bit) ((bit) % BITMAP_WORD_BITS)
+
+/* number of summary levels above the bitmap, every level has one bit per word of the level below */
+#define BITMAP_SUMMARY_LEVELS   2
+
+struct __bitmap_summary_t;
 
 typedef struct {
     size_t size;            // size in bits 
-    uint8_t* data;
+    uint64_t* data;
+    struct __bitmap_summary_t* summary;     // optional, NULL if bitmap is not summarized
 } bitmap_t;
 
+/*
+ * hierarchical summary of a bitmap
+ * NOTE: level 0 has one bit per data word (64 bits), level 1 one bit per level 0 word (4096 bits)
+ */
+typedef struct __bitmap_summary_t {
+    bitmap_t full[BITMAP_SUMMARY_LEVELS];       // bit set iff word below is all 1's
+    bitmap_t empty[BITMAP_SUMMARY_LEVELS];      // bit set iff word below is all 0's
+} bitmap_summary_t;
+
+void bitmap_summarize(bitmap_t* bitmap, size_t first_word, size_t last_word);
+
 static inline void bitmap_set(bitmap_t* bitmap, size_t bit) {
-    const size_t byte_index = get_byte_index(bit);
+    const size_t word_index = get_word_index(bit);
     const size_t bit_index = get_bit_index(bit);
 
-    bitmap->data[byte_index] |= (1 << bit_index);
+    bitmap->data[word_index] |= ((uint64_t) 1 << bit_index);
+    if (bitmap->summary)
+        bitmap_summarize(bitmap, word_index, word_index);
 }
 
 static inline void bitmap_clear(bitmap_t* bitmap, size_t bit) {
-    const size_t byte_index = get_byte_index(bit);
+    const size_t word_index = get_word_index(bit);
     const size_t bit_index = get_bit_index(bit);
 
-    bitmap->data[byte_index] &= ~(1 << bit_index);
+    bitmap->data[word_index] &= ~((uint64_t) 1 << bit_index);
+    if (bitmap->summary)
+        bitmap_summarize(bitmap, word_index, word_index);
 }
 
 static inline bool bitmap_get(bitmap_t* bitmap, size_t bit) {
-    const size_t byte_index = get_byte_index(bit);
+    const size_t word_index = get_word_index(bit);
     const size_t bit_index = get_bit_index(bit);
 
-    return bitmap->data[byte_index] & (1 << bit_index);  
+    return (bitmap->data[word_index] >> bit_index) & 1;
 }
 
-static inline void bitmap_set_range(bitmap_t* bitmap, size_t bit, size_t num_bits) {
-    for (size_t i = 0; i < num_bits; i++) 
-        bitmap_set(bitmap, bit + i);
+static inline size_t bitmap_size_words(bitmap_t* bitmap) {
+    return (bitmap->size / BITMAP_WORD_BITS) + (bitmap->size % BITMAP_WORD_BITS ? 1 : 0);
 }
 
-static inline void bitmap_clear_range(bitmap_t* bitmap, size_t bit, size_t num_bits) {
-    for (size_t i = 0; i < num_bits; i++) 
-        bitmap_clear(bitmap, bit + i);
+static inline size_t bitmap_size_bytes(bitmap_t* bitmap) {
+    return bitmap_size_words(bitmap) * sizeof(uint64_t);
 }
 
-static inline size_t bitmap_size_bytes(bitmap_t* bitmap) {
-    return (bitmap->size / 8) + (bitmap->size % 8 ? 1 : 0);
+/*
+ * bitmap_summary_size_bytes
+ * @returns bytes needed for all summary levels of @param bitmap
+ */
+static inline size_t bitmap_summary_size_bytes(bitmap_t* bitmap) {
+    size_t bytes = 0;
+    size_t bits = bitmap_size_words(bitmap);
+
+    for (size_t level = 0; level < BITMAP_SUMMARY_LEVELS; level++) {
+        bitmap_t tmp = { .size = bits };
+        bytes += 2 * bitmap_size_bytes(&tmp);
+        bits = bitmap_size_words(&tmp);
+    }
+
+    return bytes;
 }
 
+void bitmap_summary_init(bitmap_t* bitmap, bitmap_summary_t* summary, uint64_t* buf);
+void bitmap_set_range(bitmap_t* bitmap, size_t bit, size_t num_bits);
+void bitmap_clear_range(bitmap_t* bitmap, size_t bit, size_t num_bits);
 size_t bitmap_find_range(bitmap_t* bitmap, size_t first_idx, bool bit, size_t length);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <sys/sys.h>
+
+/*
+ * Kraken's arena
+ *
+ * An arena hands out memory by bumping a pointer through a region. Objects have no headers and
+ * are never freed one by one: the arena is either reset to a mark taken earlier or released as
+ * a whole. This fits structures that are built once (i.e. while parsing firmware tables) or
+ * freed together.
+ *
+ * An arena starts on an optional caller provided buffer and, if it has a chunk size, continues
+ * on chunks taken from the kernel heap once that is used up. Arenas without a chunk size never
+ * touch the heap and can be used before it exists.
+ *
+ * Memory handed out by an arena is not zeroed.
+ *
+ */
+
+#define ARENA_MIN_ALIGN     8
+
+/* region taken from the kernel heap, the arena allocates from the bytes behind this header */
+typedef struct __arena_chunk_t {
+    struct __arena_chunk_t* prev;   // previously used chunk, NULL for the first
+    uint8_t* end;
+} arena_chunk_t;
+
+typedef struct {
+    uint8_t* ptr;                   // next free byte
+    uint8_t* end;                   // end of the current region
+    arena_chunk_t* chunk;           // current chunk, NULL while allocating from the buffer
+    uint8_t* buf;                   // caller provided buffer, NULL if none
+    uint8_t* buf_end;
+    size_t chunk_size;              // bytes taken from the kernel heap at once, 0 if the arena cannot grow
+} arena_t;
+
+/* position in an arena, everything allocated after it is given back by arena_reset */
+typedef struct {
+    arena_chunk_t* chunk;
+    uint8_t* ptr;
+} arena_mark_t;
+
+/* heap backed arena without a buffer */
+#define ARENA_INIT(size)    { .ptr = NULL, .end = NULL, .chunk = NULL, .buf = NULL, .buf_end = NULL, .chunk_size = (size) }
+
+void arena_init(arena_t* arena, void* buf, size_t size, size_t chunk_size);
+void* arena_alloc(arena_t* arena, size_t size, size_t align);
+arena_mark_t arena_mark(arena_t* arena);
+void arena_reset(arena_t* arena, arena_mark_t mark);
+void arena_release(arena_t* arena);
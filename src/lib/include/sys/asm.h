@@ -5,8 +5,20 @@
 #define cli()   asm volatile ("cli")
 #define sti()   asm volatile ("sti")
 
+/* spin-wait hint */
+#define pause() asm volatile ("pause")
+
+/* time stamp counter */
+#define rdtsc(val)      asm volatile("rdtsc; shlq $32, %%rdx; orq %%rdx, %%rax" : "=a" (val) : : "rdx")
+
+/* rflags */
+#define dump_rflags(val)    asm volatile("pushfq; popq %0" : "=r" (val) : : "memory")
+#define load_rflags(val)    asm volatile("pushq %0; popfq" : : "r" ((uint64_t) val) : "memory", "cc")
+
 /* x86 paging */
 #define dump_cr2(val)   asm volatile("mov %%cr2, %0" : "=r" (val) : : )
 #define load_cr3(val)   asm volatile("mov %0, %%cr3" : : "r" ((uint64_t) val) : )
 #define dump_cr3(val)   asm volatile("mov %%cr3, %0" : "=r" (val) : : )
+#define load_cr4(val)   asm volatile("mov %0, %%cr4" : : "r" ((uint64_t) val) : )
+#define dump_cr4(val)   asm volatile("mov %%cr4, %0" : "=r" (val) : : )
 #define invlpg(vaddr)   asm volatile("invlpg (%0)" : : "r" (vaddr) : "memory")
\ No newline at end of file
@@ -16,3 +16,70 @@ static inline int cpuid_va_pa_sizes(void) {
     __get_cpuid(0x80000008, &eax, &ebx, &ecx, &edx);
     return eax;
 }
+
+/* 
+ * 1 GiB pages: edx bit 26 of leaf 0x80000001
+ */
+static inline bool cpuid_page_1gb(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (edx >> 26) & 1;
+}
+
+/* 
+ * global pages: edx bit 13 of leaf 1
+ */
+static inline bool cpuid_pge(void) {
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    return (edx >> 13) & 1;
+}
+
+/* 
+ * process context identifiers: ecx bit 17 of leaf 1
+ */
+static inline bool cpuid_pcid(void) {
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    return (ecx >> 17) & 1;
+}
+
+/* 
+ * initial apic id of the current processor: (ebx >> 24) & 0xFF
+ */
+static inline uint32_t cpuid_apic_id(void) {
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    return (ebx >> 24) & 0xFF;
+}
+
+/* 
+ * size of one way (cache size / associativity) of the data or unified cache at @param level, 0 if unknown
+ * deterministic cache parameters: leaf 4 (intel) or 0x8000001D (amd), one subleaf per cache
+ * line size: (ebx & 0xFFF) + 1, partitions: ((ebx >> 12) & 0x3FF) + 1, sets: ecx + 1
+ */
+static inline size_t cpuid_cache_way_size(unsigned int level) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int leaves[2] = { 4, 0x8000001D };
+
+    for (int i = 0; i < 2; i++) {
+        if (__get_cpuid_max(leaves[i] & 0x80000000, NULL) < leaves[i])
+            continue;
+
+        for (unsigned int subleaf = 0; subleaf < 16; subleaf++) {
+            __cpuid_count(leaves[i], subleaf, eax, ebx, ecx, edx);
+
+            // type 0: no more caches, type 2: instruction cache
+            unsigned int type = eax & 0x1F;
+            if (type == 0)
+                break;
+            if (type == 2 || ((eax >> 5) & 0x7) != level)
+                continue;
+
+            return (size_t) ((ebx & 0xFFF) + 1) * (((ebx >> 12) & 0x3FF) + 1) * (ecx + 1);
+        }
+    }
+
+    return 0;
+}
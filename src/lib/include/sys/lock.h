@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/asm.h>
+
+/* 
+ * simple test-and-test-and-set spinlock
+ * NOTE: does not disable interrupts, callers that share data with interrupt 
+ * handlers must save rflags and cli() themselves
+ */
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT   { .locked = 0 }
+
+static inline void spin_lock(spinlock_t* lock) {
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+            pause();
+    }
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* 
+ * spin_lock_irqsave
+ * disables interrupts and takes @param lock
+ * @returns rflags to restore with spin_unlock_irqrestore
+ */
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t rflags;
+    dump_rflags(rflags);
+    cli();
+    spin_lock(lock);
+    return rflags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t rflags) {
+    spin_unlock(lock);
+    load_rflags(rflags);
+}
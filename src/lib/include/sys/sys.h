@@ -10,3 +10,4 @@
 #include <sys/io.h>
 #include <sys/panic.h>
 #include <sys/cpuid.h>
+#include <sys/lock.h>
@@ -0,0 +1,101 @@
+#include <mem/arena.h>
+
+#include <mm/kheap.h>
+#include <log.h>
+
+/*
+ * arena_init
+ * initializes @param arena on @param buf of @param size bytes
+ * @param buf : first region of the arena, may be NULL
+ * @param chunk_size : bytes taken from the kernel heap once the arena is full, 0 if the arena must not grow
+ */
+void arena_init(arena_t* arena, void* buf, size_t size, size_t chunk_size) {
+    arena->buf = (uint8_t*) buf;
+    arena->buf_end = (buf != NULL) ? (uint8_t*) buf + size : NULL;
+    arena->ptr = arena->buf;
+    arena->end = arena->buf_end;
+    arena->chunk = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+/*
+ * arena_alloc
+ * allocates @param size bytes from @param arena
+ * @param align : alignment of the allocation, at least ARENA_MIN_ALIGN
+ * @returns pointer to allocated area or NULL if the arena is full and cannot grow
+ */
+void* arena_alloc(arena_t* arena, size_t size, size_t align) {
+    align = MAX(align, ARENA_MIN_ALIGN);
+
+    // bump within current region
+    if (arena->ptr != NULL) {
+        uint8_t* ret = (uint8_t*) ALIGN_UP((uintptr_t) arena->ptr, align);
+        if (ret <= arena->end && size <= (size_t) (arena->end - ret)) {
+            arena->ptr = ret + size;
+            return ret;
+        }
+    }
+
+    if (arena->chunk_size == 0)
+        return NULL;
+
+    // continue on a new chunk, the rest of the current region is left unused
+    size_t bytes = MAX(arena->chunk_size, sizeof(arena_chunk_t) + size + align);
+    arena_chunk_t* chunk = (arena_chunk_t*) kmalloc(bytes);
+    if (chunk == NULL) {
+        error("[arena_alloc] failed to grow arena by 0x%lx bytes\n", bytes);
+        return NULL;
+    }
+
+    chunk->prev = arena->chunk;
+    chunk->end = (uint8_t*) chunk + bytes;
+    arena->chunk = chunk;
+    arena->end = chunk->end;
+
+    uint8_t* ret = (uint8_t*) ALIGN_UP((uintptr_t) (chunk + 1), align);
+    arena->ptr = ret + size;
+    return ret;
+}
+
+/*
+ * arena_mark
+ * @returns current position of @param arena for arena_reset
+ */
+arena_mark_t arena_mark(arena_t* arena) {
+    return (arena_mark_t) { .chunk = arena->chunk, .ptr = arena->ptr };
+}
+
+/*
+ * arena_reset
+ * frees everything allocated from @param arena after @param mark was taken
+ * chunks taken after the mark are given back to the kernel heap
+ */
+void arena_reset(arena_t* arena, arena_mark_t mark) {
+    // the mark's chunk has to be in the chain, it is checked before anything is freed so the arena is left untouched
+    arena_chunk_t* chunk = arena->chunk;
+    while (chunk != mark.chunk) {
+        if (chunk == NULL) {
+            error("[arena_reset] mark does not belong to arena\n");
+            return;
+        }
+
+        chunk = chunk->prev;
+    }
+
+    while (arena->chunk != mark.chunk) {
+        arena_chunk_t* prev = arena->chunk->prev;
+        kfree(arena->chunk);
+        arena->chunk = prev;
+    }
+
+    arena->ptr = mark.ptr;
+    arena->end = (arena->chunk != NULL) ? arena->chunk->end : arena->buf_end;
+}
+
+/*
+ * arena_release
+ * frees everything allocated from @param arena, it can be used again afterwards
+ */
+void arena_release(arena_t* arena) {
+    arena_reset(arena, (arena_mark_t) { .chunk = NULL, .ptr = arena->buf });
+}